@@ -1,9 +1,35 @@
 #include <unordered_map>
-#include <unordered_set>
-#include <string>
-#include <queue>
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <cstring>
+#include <cstdint>
+#include <cstdio>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "poset.h"
+#include "poset_bitset.h"
+#include "poset_file.h"
+#include "poset_trace.h"
 
 #ifdef NDEBUG
 bool constexpr debug = false;
@@ -12,622 +38,5169 @@ bool constexpr debug = true;
 #endif
 
 using std::unordered_map;
-using std::unordered_set;
-using std::string;
-using std::queue;
+using std::vector;
+using std::string_view;
+using std::unique_ptr;
+using std::shared_mutex;
 using std::cerr;
 
-using poset_map = unordered_map<unsigned long, unordered_map<const string*,
-	unordered_set<const string*>>>;
-using data_container = unordered_map<unsigned long, unordered_set<string>>;
+//Dense index of an element inside its poset.
+using element_id = uint32_t;
 
-//Mapping of the poset's id to all its relations.
-//It wil hold pointers to strings in poset_elements.
-poset_map& poset_collection() {
-	static poset_map* poset_collection = new poset_map();
-	return *poset_collection;
-}
+//Marks the value which isn't in the poset.
+element_id constexpr noElement = UINT32_MAX;
 
-//Mapping of the poset's id to all its elements.
-//It will hold strings.
-data_container& poset_elements() {
-	static data_container* poset_elements = new data_container();
-	return *poset_elements;
-}
+//Containers of a poset are split into chunks, shared by the copies
+//of the poset: its clones and snapshots. Chunks shared by several copies
+//are never modified. The copy which writes to one of them gets its own
+//copy of that chunk first, so copying a poset copies only the pointers
+//to its chunks, and writing to a copy costs as much as the chunks
+//it changes.
 
-namespace {
-	//Keeps the information about the id of the last created poset.
-	//Used to create new posets with unique ids.
-	unsigned long last_id = 0;
+//Chunks of a single container. The copies share the ownership
+//of the chunks through a tree indexed by the chunk's number (a radix
+//tree), whose nodes are shared as well, so copying the container takes
+//a single reference to the root, and writing to a chunk of a copy copies
+//only the nodes on the path to the chunk. Reads go through the flat list
+//of the chunks, which each copy keeps for itself. Chunks replaced
+//by the copies stay alive until releaseReplaced, so references into them
+//stay valid until the end of the modification, even if the other owners
+//free them in the meantime.
+template <typename Chunk>
+class SharedChunks {
+public:
+	SharedChunks() = default;
 
-	//Searches for the poset with the given id in the poset_collection.
-	bool findKeyInCollection(unsigned long id) {
-		if (poset_collection().find(id) != poset_collection().end()) {
-			return true;
+	SharedChunks(const SharedChunks& other) : root(other.root),
+		height(other.height), chunks(other.chunks) {
+		if (root != nullptr) {
+			acquire(root, height);
 		}
-		else {
-			return false;
+	}
+
+	SharedChunks(SharedChunks&& other) noexcept {
+		swap(other);
+	}
+
+	SharedChunks& operator=(SharedChunks other) {
+		swap(other);
+		return *this;
+	}
+
+	~SharedChunks() {
+		clear();
+		releaseReplaced();
+	}
+
+	void swap(SharedChunks& other) {
+		std::swap(root, other.root);
+		std::swap(height, other.height);
+		chunks.swap(other.chunks);
+		replaced.swap(other.replaced);
+	}
+
+	size_t size() const {
+		return chunks.size();
+	}
+
+	const Chunk& operator[](size_t index) const {
+		return *chunks[index];
+	}
+
+	//Returns the chunk for writing, copying it first if it's shared.
+	Chunk& edit(size_t index) {
+		void** item = &root;
+		for (unsigned level = height; level > 0; --level) {
+			item = &ownNode(*item, level).children[childOf(index, level)];
 		}
+		Chunk* chunk = static_cast<Chunk*>(*item);
+		//Pairs with the release by the other owners, so they are done
+		//reading the chunk before it's modified.
+		if (chunk->owners.load(std::memory_order_acquire) != 1) {
+			replaced.push_back(chunk);
+			chunk = new Chunk(*chunk);
+			*item = chunk;
+			chunks[index] = chunk;
+		}
+		return *chunk;
 	}
 
-	//Searches for the poset in the poset_elements.
-	bool findKeyInElements(unsigned long id) {
-		if (poset_elements().find(id) != poset_elements().end()) {
-			return true;
+	//Adds the new chunk, taking its ownership.
+	void append(Chunk* chunk) {
+		size_t count = chunks.size();
+		chunks.push_back(chunk);
+		if (root != nullptr && count == size_t(1) << height * nodeBits) {
+			//The tree is full, so it becomes the first child of a new root.
+			Node* node = new Node();
+			node->children[0] = root;
+			root = node;
+			++height;
 		}
-		else {
-			return false;
+		void** item = &root;
+		for (unsigned level = height; level > 0; --level) {
+			if (*item == nullptr) {
+				*item = new Node();
+			}
+			item = &ownNode(*item, level).children[childOf(count, level)];
 		}
+		*item = chunk;
 	}
 
-	//Checks whether the given value is in poset marked with the id.
-	bool findValueInPoset(unsigned long id, char const* value) {
-		if (poset_elements()[id].find(value) != poset_elements()[id].end()) {
-			return true;
+	//Drops all the chunks.
+	void clear() {
+		if (root != nullptr) {
+			release(root, height);
 		}
-		else {
-			return false;
+		root = nullptr;
+		height = 0;
+		chunks.clear();
+	}
+
+	//Drops the chunks replaced by the copies so far.
+	void releaseReplaced() {
+		for (Chunk* chunk : replaced) {
+			release(chunk, 0);
 		}
+		replaced.clear();
 	}
 
-	//Checks whether the given value is in relation with something.
-	bool findValueInCollection(unsigned long id, char const* value) {
-		auto valueIter = poset_elements()[id].find(value);
-		if (poset_collection()[id].find(&*valueIter) !=
-			poset_collection()[id].end()) {
-			return true;
+private:
+	static unsigned constexpr nodeBits = 5;
+	static size_t constexpr nodeSize = size_t(1) << nodeBits;
+
+	//Node of the tree. Its children are the chunks on the lowest level,
+	//and the nodes of the level below on the others.
+	struct Node {
+		Node() = default;
+
+		Node(const Node& other) {
+			std::copy_n(other.children, nodeSize, children);
 		}
-		else {
-			return false;
+
+		std::atomic<size_t> owners{ 1 };
+		void* children[nodeSize]{};
+	};
+
+	//Index of the child on the path to the given chunk.
+	static size_t childOf(size_t index, unsigned level) {
+		return (index >> (level - 1) * nodeBits) & (nodeSize - 1);
+	}
+
+	//Returns the node on the given level for writing, copying it first
+	//if it's shared.
+	Node& ownNode(void*& item, unsigned level) {
+		Node* node = static_cast<Node*>(item);
+		if (node->owners.load(std::memory_order_acquire) != 1) {
+			Node* copy = new Node(*node);
+			for (void* child : copy->children) {
+				if (child != nullptr) {
+					acquire(child, level - 1);
+				}
+			}
+			release(node, level);
+			item = node = copy;
 		}
+		return *node;
 	}
 
-	//Checks whether the value1 is the parent of the value2.
-	//Said operation is realised as BFS.
-	bool findParent(unsigned long id, char const* value1, char const* value2) {
-		queue<const string*> BSTqueue;
-		auto value1Iter = poset_elements()[id].find(value1);
-		auto value2Iter = poset_elements()[id].find(value2);
-		for (const string* s : poset_collection()[id][&*value1Iter]) {
-			BSTqueue.push(s);
-		}
-
-		while (!BSTqueue.empty()) {
-			const string* s = BSTqueue.front();
-			BSTqueue.pop();
-			if (s == &*value2Iter) {
-				//value1 is the parent of the value2.
-				return true;
+	static std::atomic<size_t>& ownersOf(void* item, unsigned level) {
+		return level == 0 ? static_cast<Chunk*>(item)->owners :
+			static_cast<Node*>(item)->owners;
+	}
+
+	static void acquire(void* item, unsigned level) {
+		ownersOf(item, level).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//Drops a reference to the chunk or the node on the given level,
+	//freeing it if it was the last one.
+	static void release(void* item, unsigned level) {
+		if (ownersOf(item, level).fetch_sub(1,
+			std::memory_order_acq_rel) != 1) {
+			return;
+		}
+		if (level == 0) {
+			delete static_cast<Chunk*>(item);
+			return;
+		}
+		Node* node = static_cast<Node*>(item);
+		for (void* child : node->children) {
+			if (child != nullptr) {
+				release(child, level - 1);
 			}
-			else {
-				//We continue BFS algorithm.
-				for (const string* s2 : poset_collection()[id][s]) {
-					BSTqueue.push(s2);
-				}
+		}
+		delete node;
+	}
+
+	void* root = nullptr;
+	//Number of the levels of nodes above the chunks.
+	unsigned height = 0;
+	vector<Chunk*> chunks;
+	vector<Chunk*> replaced;
+};
+
+//Array split into the shared chunks of Chunk::size items each. Items
+//past the end keep their initial values, and their chunks are kept
+//for the next items, until the array is cleared.
+template <typename Chunk>
+class ChunkedArray {
+public:
+	using value_type = typename Chunk::value_type;
+
+	class const_iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = typename Chunk::value_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+
+		const_iterator(const ChunkedArray* array, size_t index) :
+			array(array), index(index) {
+		}
+
+		reference operator*() const {
+			return (*array)[index];
+		}
+
+		const_iterator& operator++() {
+			++index;
+			return *this;
+		}
+
+		bool operator==(const const_iterator& other) const {
+			return index == other.index;
+		}
+
+		bool operator!=(const const_iterator& other) const {
+			return index != other.index;
+		}
+
+	private:
+		const ChunkedArray* array;
+		size_t index;
+	};
+
+	size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	const value_type& operator[](size_t index) const {
+		return chunks[index / Chunk::size].items[index % Chunk::size];
+	}
+
+	const value_type& back() const {
+		return (*this)[count - 1];
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, count);
+	}
+
+	//Returns the item for writing.
+	value_type& edit(size_t index) {
+		return chunks.edit(index / Chunk::size).items[index % Chunk::size];
+	}
+
+	//Gives the item its initial value back.
+	void reset(size_t index) {
+		chunks.edit(index / Chunk::size).reset(index % Chunk::size);
+	}
+
+	//Sets the item with the chunk's own assign, for the items which keep
+	//their data in the chunk.
+	template <typename... Args>
+	void assign(size_t index, Args&&... args) {
+		chunks.edit(index / Chunk::size).assign(index % Chunk::size,
+			std::forward<Args>(args)...);
+	}
+
+	void push_back(const value_type& value) {
+		resize(count + 1);
+		edit(count - 1) = value;
+	}
+
+	void pop_back() {
+		resize(count - 1);
+	}
+
+	//Resizes the array. New items have their initial values.
+	void resize(size_t size) {
+		for (size_t index = size; index < count; ++index) {
+			reset(index);
+		}
+		while (chunks.size() * Chunk::size < size) {
+			chunks.append(new Chunk());
+		}
+		count = size;
+	}
+
+	//Empties the array and drops all its chunks.
+	void clear() {
+		chunks.clear();
+		count = 0;
+	}
+
+	void releaseReplaced() {
+		chunks.releaseReplaced();
+	}
+
+private:
+	SharedChunks<Chunk> chunks;
+	size_t count = 0;
+};
+
+//Chunk of plain values, initially zero.
+template <typename T, size_t N>
+struct ValueChunk {
+	using value_type = T;
+	static size_t constexpr size = N;
+
+	ValueChunk() = default;
+
+	ValueChunk(const ValueChunk& other) {
+		std::copy_n(other.items, size, items);
+	}
+
+	void reset(size_t index) {
+		items[index] = T();
+	}
+
+	std::atomic<size_t> owners{ 1 };
+	T items[size]{};
+};
+
+using IndexArray = ChunkedArray<ValueChunk<element_id, 1024>>;
+
+//Memory of a chunk. Pieces are carved from the front of the last block,
+//and freed pieces are kept in lists by their size, rounded up to a power
+//of two, so allocating and freeing take a few instructions. The pieces
+//are aligned to 8 bytes. The blocks are freed together with the pool.
+class ChunkPool : public std::pmr::memory_resource {
+public:
+	ChunkPool() = default;
+	ChunkPool(const ChunkPool&) = delete;
+	ChunkPool& operator=(const ChunkPool&) = delete;
+
+	~ChunkPool() {
+		for (void* block : blocks) {
+			::operator delete(block);
+		}
+	}
+
+private:
+	static size_t constexpr blockSize = 4096;
+	static unsigned constexpr minOrder = 3;
+
+	//Exponent of the size of the pieces holding the given number of bytes.
+	static unsigned orderOf(size_t bytes) {
+		unsigned order = minOrder;
+		while ((size_t(1) << order) < bytes) {
+			++order;
+		}
+		return order;
+	}
+
+	void* do_allocate(size_t bytes, size_t) override {
+		unsigned order = orderOf(bytes);
+		if (freed[order] != nullptr) {
+			void* piece = freed[order];
+			freed[order] = *static_cast<void**>(piece);
+			return piece;
+		}
+		size_t size = size_t(1) << order;
+		if (size > blockSize) {
+			blocks.push_back(::operator new(size));
+			return blocks.back();
+		}
+		if (left < size) {
+			blocks.push_back(::operator new(blockSize));
+			next = static_cast<char*>(blocks.back());
+			left = blockSize;
+		}
+		void* piece = next;
+		next += size;
+		left -= size;
+		return piece;
+	}
+
+	void do_deallocate(void* piece, size_t bytes, size_t) override {
+		unsigned order = orderOf(bytes);
+		*static_cast<void**>(piece) = freed[order];
+		freed[order] = piece;
+	}
+
+	bool do_is_equal(const memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+
+	vector<void*> blocks;
+	char* next = nullptr;
+	size_t left = 0;
+	void* freed[64]{};
+};
+
+//Containers of a chunk, allocating from the chunk's own pool, so freeing
+//the chunk frees all of them at once, instead of every list separately.
+using element_list = std::pmr::vector<element_id>;
+
+//Chunk of the rows of an adjacency. The rows aren't destroyed with
+//the chunk: its pool frees their items all at once.
+struct RowChunk {
+	using value_type = element_list;
+	static size_t constexpr size = 256;
+
+	RowChunk() {
+		for (element_list& row : items) {
+			new (&row) element_list(&pool);
+		}
+	}
+
+	RowChunk(const RowChunk& other) {
+		for (size_t index = 0; index < size; ++index) {
+			new (&items[index]) element_list(other.items[index], &pool);
+		}
+	}
+
+	~RowChunk() {
+	}
+
+	void reset(size_t index) {
+		items[index].clear();
+		items[index].shrink_to_fit();
+	}
+
+	std::atomic<size_t> owners{ 1 };
+	ChunkPool pool;
+	union {
+		element_list items[size];
+	};
+};
+
+using RowArray = ChunkedArray<RowChunk>;
+
+//Chunk of the names of the elements. Names are null-terminated copies
+//allocated from the chunk's pool. Free indices have null names.
+struct NameChunk {
+	using value_type = string_view;
+	static size_t constexpr size = 256;
+
+	NameChunk() = default;
+
+	NameChunk(const NameChunk& other) {
+		for (size_t index = 0; index < size; ++index) {
+			if (other.items[index].data() != nullptr) {
+				assign(index, other.items[index]);
 			}
 		}
-		//We didn't find value1, so it's not a parent of the value2.
-		return false;
 	}
 
-	//Checks whether the value1 is the parent of the value2.
-	//Said operation is realised as BFS.
-	bool findParent(unsigned long id, const string* value1,
-		char const* value2) {
-		queue<const string*> BSTqueue;
-		auto value1Iter = poset_elements()[id].find(*value1);
-		auto value2Iter = poset_elements()[id].find(value2);
-		for (const string* s : poset_collection()[id][&*value1Iter]) {
-			BSTqueue.push(s);
-		}
-
-		while (!BSTqueue.empty()) {
-			const string* s = BSTqueue.front();
-			BSTqueue.pop();
-			if (s == &*value2Iter) {
-				//value1 is the parent of the value2.
-				return true;
+	//Copies the given name into the chunk.
+	void assign(size_t index, string_view value) {
+		reset(index);
+		char* name = static_cast<char*>(pool.allocate(value.size() + 1, 1));
+		std::copy(value.begin(), value.end(), name);
+		name[value.size()] = '\0';
+		items[index] = string_view(name, value.size());
+	}
+
+	void reset(size_t index) {
+		if (items[index].data() != nullptr) {
+			pool.deallocate(const_cast<char*>(items[index].data()),
+				items[index].size() + 1, 1);
+			items[index] = string_view();
+		}
+	}
+
+	std::atomic<size_t> owners{ 1 };
+	ChunkPool pool;
+	string_view items[size];
+};
+
+using NameArray = ChunkedArray<NameChunk>;
+
+//Chunk of the rows of the closure, all of the same number of words.
+struct ClosureChunk {
+	static size_t constexpr size = 64;
+
+	explicit ClosureChunk(size_t words) : words(size * words, 0) {
+	}
+
+	ClosureChunk(const ClosureChunk& other) : words(other.words) {
+	}
+
+	std::atomic<size_t> owners{ 1 };
+	vector<uint64_t> words;
+};
+
+//Mapping of the element's name to its index: a hash table with open
+//addressing and linear probing, like the index of the poset files. A slot
+//holds the upper half of the name's hash in its upper half, and the index
+//plus one in the lower one, or 0 if it's empty. The upper bits of the hash
+//select the first probed slot, so the table grows without hashing
+//the names again.
+class NameIndex {
+public:
+	size_t size() const {
+		return count;
+	}
+
+	//Returns the index of the given value, or noElement if the value
+	//isn't in the table. Looking a value up doesn't allocate.
+	element_id find(const NameArray& names, string_view value) const {
+		if (count == 0) {
+			return noElement;
+		}
+		uint32_t tag = tagOf(value);
+		size_t mask = slots.size() - 1;
+		for (size_t slot = home(tag);; slot = (slot + 1) & mask) {
+			uint64_t entry = slots[slot];
+			if (entry == 0) {
+				return noElement;
 			}
-			else {
-				//We continue BFS algorithm.
-				for (const string* s2 : poset_collection()[id][s]) {
-					BSTqueue.push(s2);
+			element_id element = static_cast<element_id>(entry) - 1;
+			if ((entry >> 32) == tag && names[element] == value) {
+				return element;
+			}
+		}
+	}
+
+	//Adds the name of the given element, which isn't in the table yet.
+	void insert(string_view value, element_id element) {
+		reserve(count + 1);
+		place(uint64_t(tagOf(value)) << 32 | (uint64_t(element) + 1));
+		++count;
+	}
+
+	//Deletes the name of the given element from the table. Entries after
+	//it are shifted back, so no probe sequence gets broken.
+	void erase(string_view value, element_id element) {
+		uint64_t entry = uint64_t(tagOf(value)) << 32 |
+			(uint64_t(element) + 1);
+		size_t mask = slots.size() - 1;
+		size_t hole = home(tagOf(value));
+		while (slots[hole] != entry) {
+			hole = (hole + 1) & mask;
+		}
+		for (size_t slot = (hole + 1) & mask; slots[slot] != 0;
+			slot = (slot + 1) & mask) {
+			//The entry can fill the hole, unless its first probed slot
+			//lies between them.
+			size_t first = home(static_cast<uint32_t>(slots[slot] >> 32));
+			if (((slot - first) & mask) >= ((slot - hole) & mask)) {
+				slots.edit(hole) = slots[slot];
+				hole = slot;
+			}
+		}
+		slots.edit(hole) = 0;
+		--count;
+	}
+
+	//Makes the table big enough for the given number of names, keeping
+	//at most half of the slots full.
+	void reserve(size_t size) {
+		if (size * 2 <= slots.size()) {
+			return;
+		}
+		size_t slotCount = 16;
+		unsigned bits = 4;
+		while (slotCount < size * 2) {
+			slotCount *= 2;
+			++bits;
+		}
+		IndexTable old = std::move(slots);
+		slots = IndexTable();
+		slots.resize(slotCount);
+		shift = 32 - bits;
+		for (size_t slot = 0; slot < old.size(); ++slot) {
+			if (old[slot] != 0) {
+				place(old[slot]);
+			}
+		}
+	}
+
+	void releaseReplaced() {
+		slots.releaseReplaced();
+	}
+
+private:
+	using IndexTable = ChunkedArray<ValueChunk<uint64_t, 512>>;
+
+	static uint32_t tagOf(string_view value) {
+		uint64_t hash = std::hash<string_view>()(value);
+		//Fibonacci hashing spreads the hashes into the upper bits.
+		return static_cast<uint32_t>((hash * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	size_t home(uint32_t tag) const {
+		return tag >> shift;
+	}
+
+	//Puts the entry into the first free slot of its probe sequence.
+	void place(uint64_t entry) {
+		size_t mask = slots.size() - 1;
+		size_t slot = home(static_cast<uint32_t>(entry >> 32));
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		slots.edit(slot) = entry;
+	}
+
+	IndexTable slots;
+	size_t count = 0;
+	//Shift of the tag which leaves the bits of the first probed slot.
+	unsigned shift = 32;
+};
+
+//Set of indices, with constant time insertion and deletion.
+struct IndexSet {
+	//Indices in the set, in no particular order.
+	IndexArray items;
+	//positions[i] is the position of the index i in items plus one,
+	//or 0 if the index isn't in the set.
+	IndexArray positions;
+
+	bool contains(element_id index) const {
+		return index < positions.size() && positions[index] != 0;
+	}
+
+	void insert(element_id index) {
+		if (positions.size() <= index) {
+			positions.resize(index + 1);
+		}
+		positions.edit(index) = static_cast<uint32_t>(items.size()) + 1;
+		items.push_back(index);
+	}
+
+	//Moves the last index into the place of the deleted one.
+	void erase(element_id index) {
+		element_id last = items.back();
+		uint32_t position = positions[index];
+		items.edit(position - 1) = last;
+		positions.edit(last) = position;
+		items.pop_back();
+		positions.edit(index) = 0;
+	}
+
+	void releaseReplaced() {
+		items.releaseReplaced();
+		positions.releaseReplaced();
+	}
+};
+
+//Single poset: its interned elements and the relations between them.
+//Copies of the poset share its chunks, until either of them writes
+//to them.
+struct Poset {
+	//Mapping of the element's name to its index.
+	NameIndex ids;
+	//Mapping of the index to the element's name.
+	NameArray names;
+	//children[i] holds indices of the elements directly after i.
+	RowArray children;
+	//parents[i] holds indices of the elements directly before i.
+	RowArray parents;
+	//Indices of the removed elements, reused by the next insertions.
+	IndexArray freeIds;
+	//Whether the poset keeps its reachability matrix (closure mode).
+	bool closureEnabled = false;
+	//Number of 64-bit words in a single row of the closure.
+	size_t closureWords = 0;
+	//Reachability matrix: bit j of the row i is set iff i is
+	//the parent of j. Every chunk holds ClosureChunk::size rows, one
+	//after another.
+	SharedChunks<ClosureChunk> closure;
+	//Whether the poset keeps only its covering relation (reduction mode):
+	//no relation is implied by the others, so searches walk the Hasse
+	//diagram instead of every relation ever added.
+	bool reductionEnabled = false;
+	//Whether the cached linear extension is up to date. It's computed
+	//by the first poset_linear_extension call and then maintained
+	//by the modifications.
+	bool extensionValid = false;
+	//Elements in the order of the linear extension. Removed elements
+	//leave holes (noElement) until there are too many of them.
+	IndexArray extension;
+	//extensionRank[i] is the position of the element i in the extension.
+	IndexArray extensionRank;
+	//Number of holes in the extension.
+	size_t extensionHoles = 0;
+	//Elements without parents and without children, updated with every
+	//relation, so they never have to be searched for.
+	IndexSet minimal;
+	IndexSet maximal;
+	//Number of modifications of the poset so far.
+	uint64_t generation = 0;
+
+	//Drops the chunks which the modification so far copied.
+	void releaseReplaced() {
+		ids.releaseReplaced();
+		names.releaseReplaced();
+		children.releaseReplaced();
+		parents.releaseReplaced();
+		freeIds.releaseReplaced();
+		closure.releaseReplaced();
+		extension.releaseReplaced();
+		extensionRank.releaseReplaced();
+		minimal.releaseReplaced();
+		maximal.releaseReplaced();
+	}
+};
+
+namespace {
+	//Epoch based reclamation of the data which readers use without
+	//holding any lock. Every reading thread announces the epoch in which
+	//it started in its own slot, and retired objects are freed only once
+	//no reader from their epoch or before is still running.
+	struct alignas(64) ReaderSlot {
+		//Announced epoch, or 0 if the thread isn't reading.
+		std::atomic<uint64_t> epoch{ 0 };
+		std::atomic<bool> used{ false };
+		ReaderSlot* next = nullptr;
+	};
+
+	struct Epochs {
+		std::atomic<uint64_t> current{ 1 };
+		//Slots are never freed, only reused by new threads.
+		std::atomic<ReaderSlot*> slots{ nullptr };
+		std::mutex retiredMutex;
+		vector<std::pair<uint64_t, std::function<void()>>> retired;
+	};
+
+	Epochs& epochs() {
+		static Epochs* epochs = new Epochs();
+		return *epochs;
+	}
+
+	//Owner of the calling thread's slot, releasing it on thread exit.
+	struct ReaderThread {
+		ReaderSlot* slot = nullptr;
+		unsigned depth = 0;
+
+		ReaderThread() {
+			Epochs& e = epochs();
+			for (ReaderSlot* s = e.slots.load(); s != nullptr; s = s->next) {
+				bool used = false;
+				if (s->used.compare_exchange_strong(used, true)) {
+					slot = s;
+					return;
 				}
 			}
+			slot = new ReaderSlot();
+			slot->used = true;
+			slot->next = e.slots.load();
+			while (!e.slots.compare_exchange_weak(slot->next, slot)) {
+			}
 		}
-		//We didn't find value2, so value1 is not its parent.
-		return false;
+
+		~ReaderThread() {
+			slot->epoch = 0;
+			slot->used = false;
+		}
+	};
+
+	ReaderThread& readerThread() {
+		thread_local ReaderThread thread;
+		return thread;
 	}
 
-	//Function checks, if the given string is NULL
-	string ifNULL(const char* value) {
-		if (value == nullptr) {
-			return "NULL";
+	//Keeps everything retired from now on alive while it exists.
+	class EpochGuard {
+	public:
+		EpochGuard() : thread(readerThread()) {
+			if (thread.depth++ == 0) {
+				thread.slot->epoch = epochs().current.load();
+				//Pairs with the fence in retire: either the scan there sees
+				//this epoch, or the loads of the shared pointers after it
+				//(the registry's entries, snapshots and mapped files) see
+				//them already unpublished.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+		}
+
+		~EpochGuard() {
+			if (--thread.depth == 0) {
+				thread.slot->epoch.store(0, std::memory_order_release);
+			}
+		}
+
+		EpochGuard(const EpochGuard&) = delete;
+		EpochGuard& operator=(const EpochGuard&) = delete;
+
+	private:
+		ReaderThread& thread;
+	};
+
+	//Frees the object with the given function once no reader can use it.
+	//It must already be unreachable for the new readers.
+	void retire(std::function<void()> free) {
+		Epochs& e = epochs();
+		vector<std::function<void()>> ready;
+		{
+			std::lock_guard<std::mutex> lock(e.retiredMutex);
+			e.retired.emplace_back(e.current.fetch_add(1), std::move(free));
+			//Pairs with the fence in EpochGuard: the object was unpublished
+			//before, so either its readers' epochs are seen below, or they
+			//can't load it anymore.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint64_t oldest = UINT64_MAX;
+			for (ReaderSlot* s = e.slots.load(); s != nullptr; s = s->next) {
+				uint64_t epoch = s->epoch.load();
+				if (epoch != 0) {
+					oldest = std::min(oldest, epoch);
+				}
+			}
+			//Retired objects are sorted by their epochs.
+			size_t freed = 0;
+			while (freed < e.retired.size() &&
+				e.retired[freed].first < oldest) {
+				ready.push_back(std::move(e.retired[freed].second));
+				++freed;
+			}
+			e.retired.erase(e.retired.begin(), e.retired.begin() + freed);
+		}
+		//Freeing may retire other objects, so it's done without the lock.
+		for (auto& f : ready) {
+			f();
 		}
-		return "\"" + string(value) + "\"";
 	}
 }
 
-unsigned long cxx::poset_new(void) {
-	if constexpr (debug) {
-		cerr << "poset_new()" << "\n";
+struct PosetEntry;
+
+namespace {
+	//Counters of a single API function.
+	struct OpCounters {
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> successes{ 0 };
+		std::atomic<uint64_t> failures{ 0 };
+		std::atomic<uint64_t> totalNs{ 0 };
+		std::atomic<uint64_t> latency[POSET_LATENCY_BUCKETS]{};
+	};
+
+	//Statistics of a poset, or of all the calls made by a thread.
+	struct StatsCounters {
+		OpCounters ops[cxx::POSET_OP_COUNT];
+		std::atomic<uint64_t> searches{ 0 };
+		std::atomic<uint64_t> nodesVisited{ 0 };
+		std::atomic<uint64_t> edgesScanned{ 0 };
+		std::atomic<uint64_t> cacheHits{ 0 };
+		std::atomic<uint64_t> cacheMisses{ 0 };
+	};
+
+	//Adds to the counter. Counters of a thread are written only by
+	//their owner, so they don't need an atomic addition.
+	void addCounter(std::atomic<uint64_t>& counter, uint64_t value,
+		bool shared) {
+		if (shared) {
+			counter.fetch_add(value, std::memory_order_relaxed);
+		}
+		else {
+			counter.store(counter.load(std::memory_order_relaxed) + value,
+				std::memory_order_relaxed);
+		}
+	}
+
+	//Adds the counters to the C structure.
+	void readCounters(const StatsCounters& counters,
+		struct cxx::poset_stats& stats) {
+		for (int op = 0; op < cxx::POSET_OP_COUNT; ++op) {
+			const OpCounters& from = counters.ops[op];
+			cxx::poset_op_stats& to = stats.ops[op];
+			to.calls += from.calls.load(std::memory_order_relaxed);
+			to.successes += from.successes.load(std::memory_order_relaxed);
+			to.failures += from.failures.load(std::memory_order_relaxed);
+			to.total_ns += from.totalNs.load(std::memory_order_relaxed);
+			for (int b = 0; b < POSET_LATENCY_BUCKETS; ++b) {
+				to.latency[b] += from.latency[b].load(std::memory_order_relaxed);
+			}
+		}
+		stats.searches += counters.searches.load(std::memory_order_relaxed);
+		stats.nodes_visited +=
+			counters.nodesVisited.load(std::memory_order_relaxed);
+		stats.edges_scanned +=
+			counters.edgesScanned.load(std::memory_order_relaxed);
+		stats.cache_hits += counters.cacheHits.load(std::memory_order_relaxed);
+		stats.cache_misses +=
+			counters.cacheMisses.load(std::memory_order_relaxed);
+	}
+
+	//Global statistics are kept per thread, so counting a call never
+	//touches memory shared with other threads. Blocks of finished threads
+	//are reused by the new ones and keep their counts.
+	struct alignas(64) ThreadStats {
+		StatsCounters counters;
+		std::atomic<bool> used{ false };
+		ThreadStats* next = nullptr;
+	};
+
+	std::atomic<ThreadStats*>& threadStatsList() {
+		static std::atomic<ThreadStats*>* list =
+			new std::atomic<ThreadStats*>(nullptr);
+		return *list;
 	}
 
-	unsigned long id = last_id;
-	++last_id;
-	poset_elements()[id] = unordered_set<string>();
-	poset_collection()[id] = unordered_map<const string*,
-		unordered_set<const string*>>();
+	//Owner of the calling thread's statistics block.
+	struct StatsThread {
+		ThreadStats* block = nullptr;
+
+		StatsThread() {
+			std::atomic<ThreadStats*>& list = threadStatsList();
+			for (ThreadStats* b = list.load(); b != nullptr; b = b->next) {
+				bool used = false;
+				if (b->used.compare_exchange_strong(used, true)) {
+					block = b;
+					return;
+				}
+			}
+			block = new ThreadStats();
+			block->used = true;
+			block->next = list.load();
+			while (!list.compare_exchange_weak(block->next, block)) {
+			}
+		}
+
+		~StatsThread() {
+			block->used = false;
+		}
+	};
+
+	StatsCounters& threadStats() {
+		thread_local StatsThread thread;
+		return thread.block->counters;
+	}
+
+	//What the call measured on this thread resolved so far. Set by
+	//the handles and the API functions, so the statistics and the trace
+	//can be attributed to the poset and its elements.
+	struct CallContext {
+		PosetEntry* entry;
+		unsigned long id;
+		uint32_t element1;
+		uint32_t element2;
+	};
+
+	CallContext& callContext() {
+		thread_local CallContext context;
+		return context;
+	}
+
+	void noteElements(uint32_t element1, uint32_t element2) {
+		callContext().element1 = element1;
+		callContext().element2 = element2;
+	}
+
+	//Tracing is switched at runtime, and costs a single load when it's off.
+	std::atomic<bool>& traceEnabled() {
+		static std::atomic<bool>* enabled = new std::atomic<bool>(false);
+		return *enabled;
+	}
+
+	//Per-thread ring of the last trace records. Only its owner writes it,
+	//and records are stored as relaxed atomic words, so poset_trace_dump
+	//can copy it at any time and drop the records overwritten meanwhile.
+	struct alignas(64) TraceRing {
+		static size_t constexpr capacity = 4096;
+		static size_t constexpr words = 4;
+		//Number of records written so far.
+		std::atomic<uint64_t> head{ 0 };
+		std::atomic<uint64_t> records[capacity * words]{};
+		std::atomic<bool> used{ false };
+		uint32_t thread = 0;
+		TraceRing* next = nullptr;
+	};
+
+	std::atomic<TraceRing*>& traceRings() {
+		static std::atomic<TraceRing*>* rings =
+			new std::atomic<TraceRing*>(nullptr);
+		return *rings;
+	}
+
+	//Owner of the calling thread's ring, allocated on its first record.
+	struct TraceThread {
+		TraceRing* ring = nullptr;
+
+		TraceThread() {
+			std::atomic<TraceRing*>& rings = traceRings();
+			uint32_t count = 0;
+			for (TraceRing* r = rings.load(); r != nullptr; r = r->next) {
+				bool used = false;
+				if (r->used.compare_exchange_strong(used, true)) {
+					ring = r;
+					return;
+				}
+				++count;
+			}
+			ring = new TraceRing();
+			ring->used = true;
+			ring->next = rings.load();
+			ring->thread = count;
+			while (!rings.compare_exchange_weak(ring->next, ring)) {
+				ring->thread = ring->next != nullptr ?
+					ring->next->thread + 1 : 0;
+			}
+		}
+
+		~TraceThread() {
+			ring->used = false;
+		}
+	};
+
+	void traceCall(uint64_t timestamp, cxx::poset_op op, bool result) {
+		thread_local TraceThread thread;
+		TraceRing& ring = *thread.ring;
+		const CallContext& context = callContext();
+		uint64_t head = ring.head.load(std::memory_order_relaxed);
+		std::atomic<uint64_t>* record =
+			ring.records + (head % TraceRing::capacity) * TraceRing::words;
+		record[0].store(timestamp, std::memory_order_relaxed);
+		record[1].store(context.id, std::memory_order_relaxed);
+		record[2].store(context.element1 |
+			(uint64_t(context.element2) << 32), std::memory_order_relaxed);
+		record[3].store(uint64_t(op) | (uint64_t(result) << 16) |
+			(uint64_t(ring.thread) << 32), std::memory_order_relaxed);
+		ring.head.store(head + 1, std::memory_order_release);
+	}
+}
+
+//Read-only mapping of a whole file into memory. Processes mapping
+//the same file share its physical pages.
+class MappedFile {
+public:
+	//Maps the given file. Returns nullptr if it can't be mapped.
+	static MappedFile* open(char const* path) {
+		unique_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+		LARGE_INTEGER size;
+		HANDLE mapping = NULL;
+		if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+			mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0,
+				NULL);
+		}
+		CloseHandle(handle);
+		if (mapping == NULL) {
+			return nullptr;
+		}
+		//The view keeps the mapping alive.
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == NULL) {
+			return nullptr;
+		}
+		file->dataPtr = static_cast<const char*>(data);
+		file->length = static_cast<size_t>(size.QuadPart);
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			return nullptr;
+		}
+		struct stat status;
+		void* data = MAP_FAILED;
+		if (fstat(fd, &status) == 0 && status.st_size > 0) {
+			data = mmap(nullptr, static_cast<size_t>(status.st_size),
+				PROT_READ, MAP_SHARED, fd, 0);
+		}
+		//The mapping keeps the file open.
+		close(fd);
+		if (data == MAP_FAILED) {
+			return nullptr;
+		}
+		file->dataPtr = static_cast<const char*>(data);
+		file->length = static_cast<size_t>(status.st_size);
+#endif
+		return file.release();
+	}
+
+	~MappedFile() {
+		if (dataPtr != nullptr) {
+#ifdef _WIN32
+			UnmapViewOfFile(dataPtr);
+#else
+			munmap(const_cast<char*>(dataPtr), length);
+#endif
+		}
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const {
+		return dataPtr;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+private:
+	MappedFile() = default;
+
+	const char* dataPtr = nullptr;
+	size_t length = 0;
+};
+
+namespace {
+	//Bounded cache of the recent answers of poset_test, keyed on the pair
+	//of elements and tagged with the generation of the poset, so every
+	//modification invalidates it at once. Every slot is guarded by its own
+	//sequence number, which the writer keeps odd while it writes the slot,
+	//so nobody waits: a slot being written is just a miss.
+	class TestCache {
+	public:
+		explicit TestCache(size_t size) : mask(size - 1),
+			slots(new Slot[size]) {
+		}
+
+		//Number of the slots.
+		size_t size() const {
+			return mask + 1;
+		}
+
+		//Looks the answer up. Returns false if it isn't cached.
+		bool find(element_id value1, element_id value2, uint64_t generation,
+			bool& answer) const {
+			uint64_t pair = pairOf(value1, value2);
+			const Slot& slot = slotOf(pair);
+			uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if ((sequence & 1) != 0) {
+				return false;
+			}
+			uint64_t cachedPair = slot.pair.load(std::memory_order_acquire);
+			uint64_t tag = slot.tag.load(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != sequence ||
+				cachedPair != pair || tag >> 1 != generation + 1) {
+				return false;
+			}
+			answer = (tag & 1) != 0;
+			return true;
+		}
+
+		//Caches the answer, unless another thread is writing the slot.
+		void store(element_id value1, element_id value2, uint64_t generation,
+			bool answer) {
+			uint64_t pair = pairOf(value1, value2);
+			Slot& slot = slotOf(pair);
+			uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+			if ((sequence & 1) != 0 || !slot.sequence.compare_exchange_strong(
+				sequence, sequence + 1, std::memory_order_acquire)) {
+				return;
+			}
+			slot.pair.store(pair, std::memory_order_release);
+			slot.tag.store((generation + 1) << 1 | (answer ? 1 : 0),
+				std::memory_order_release);
+			slot.sequence.store(sequence + 2, std::memory_order_release);
+		}
+
+	private:
+		struct Slot {
+			std::atomic<uint32_t> sequence{ 0 };
+			std::atomic<uint64_t> pair{ 0 };
+			//(generation + 1) << 1 | answer, or 0 if the slot is empty.
+			std::atomic<uint64_t> tag{ 0 };
+		};
+
+		static uint64_t pairOf(element_id value1, element_id value2) {
+			return static_cast<uint64_t>(value1) << 32 | value2;
+		}
+
+		//Fibonacci hashing spreads the pairs of neighbouring elements.
+		const Slot& slotOf(uint64_t pair) const {
+			return slots[(pair * 0x9E3779B97F4A7C15ull) >> 32 & mask];
+		}
+
+		Slot& slotOf(uint64_t pair) {
+			return slots[(pair * 0x9E3779B97F4A7C15ull) >> 32 & mask];
+		}
+
+		size_t mask;
+		unique_ptr<Slot[]> slots;
+	};
+}
+
+//Poset together with the lock guarding it. Readers take it shared,
+//so they can work in parallel, and writers take it exclusively.
+//In the snapshot mode, readers instead use an immutable copy of the poset
+//without taking any lock. Copies are built lazily by the first reader
+//after a modification, and retired by the writers.
+//Posets opened by poset_map are read in place from their mapped file,
+//until the first writer promotes them to the regular representation.
+//Snapshots and clones share the chunks of the poset, until a writer
+//copies the ones it modifies.
+struct PosetEntry {
+	//Id of the poset, set once it's registered.
+	unsigned long id = 0;
+	shared_mutex mutex;
+	Poset poset;
+	std::atomic<bool> snapshotsEnabled{ false };
+	std::atomic<const Poset*> snapshot{ nullptr };
+	//Lets only one reader at a time build the snapshot.
+	std::mutex snapshotMutex;
+	//Statistics of the calls on this poset. Shared by all threads.
+	StatsCounters stats;
+	//File of the poset, while it's read in place.
+	std::atomic<const MappedFile*> mapped{ nullptr };
+	//Answers of poset_test, if they're cached.
+	std::atomic<TestCache*> testCache{ nullptr };
+
+	~PosetEntry() {
+		//Entries are retired as well, so no reader can see the snapshot
+		//or the mapped file.
+		delete snapshot.load();
+		delete mapped.load();
+		delete testCache.load();
+	}
+};
+
+//Place of a single poset in the registry. Slots of the deleted posets
+//are reused by the new ones.
+struct RegistrySlot {
+	std::atomic<PosetEntry*> entry{ nullptr };
+	//Number of posets deleted from the slot so far. Guarded by
+	//the registry's mutex.
+	unsigned long generation = 0;
+};
+
+//Array of slots holding the posets. The id of a poset is the index of its
+//slot, with the slot's generation in the upper bits, so looking a poset up
+//is an array access without any lock, and the ids of the deleted posets
+//never match the posets which took their slots.
+struct Registry {
+	//Bits of the id holding the index of the slot.
+	static unsigned constexpr indexBits =
+		sizeof(unsigned long) >= 8 ? 32 : 20;
+	static unsigned long constexpr indexMask = (1ul << indexBits) - 1;
+	//Last generation which fits into the id. Slots which reach it aren't
+	//reused anymore, so no id ever repeats.
+	static unsigned long constexpr maxGeneration = ~0ul >> indexBits;
+	//Slots are allocated in chunks, which never move or get freed.
+	static size_t constexpr chunkSlots = 1024;
+	static size_t constexpr maxSlots =
+		size_t(1) << (indexBits < 24 ? indexBits : 24);
+	std::array<std::atomic<RegistrySlot*>, maxSlots / chunkSlots> chunks{};
+	//Guards creating and deleting posets, not looking them up.
+	std::mutex mutex;
+	size_t usedSlots = 0;
+	//Slots are reused in the order they were freed, so the generations
+	//of all of them grow evenly.
+	std::deque<size_t> freeSlots;
+
+	//Returns the slot with the given index, or nullptr if it wasn't
+	//allocated yet.
+	RegistrySlot* slot(size_t index) {
+		if (index >= maxSlots) {
+			return nullptr;
+		}
+		RegistrySlot* chunk =
+			chunks[index / chunkSlots].load(std::memory_order_acquire);
+		return chunk != nullptr ? chunk + index % chunkSlots : nullptr;
+	}
+};
+
+//Mapping of the poset's id to its elements and relations.
+Registry& poset_collection() {
+	static Registry* poset_collection = new Registry();
+	return *poset_collection;
+}
+
+namespace {
+	//Searches for the poset with the given id in the poset_collection.
+	//Returns nullptr if it doesn't exist. The result stays valid, even if
+	//the poset is deleted, while the calling thread holds an EpochGuard.
+	PosetEntry* findPoset(unsigned long id) {
+		RegistrySlot* slot = poset_collection().slot(id & Registry::indexMask);
+		PosetEntry* entry = slot != nullptr ?
+			slot->entry.load(std::memory_order_acquire) : nullptr;
+		//Slot may already hold a newer poset.
+		return entry != nullptr && entry->id == id ? entry : nullptr;
+	}
+
+	//Puts the poset into a free slot of the poset_collection, and returns
+	//its new id.
+	unsigned long registerPoset(unique_ptr<PosetEntry> entry) {
+		Registry& registry = poset_collection();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		size_t index;
+		if (!registry.freeSlots.empty()) {
+			index = registry.freeSlots.front();
+			registry.freeSlots.pop_front();
+		}
+		else if (registry.usedSlots < Registry::maxSlots) {
+			index = registry.usedSlots++;
+			std::atomic<RegistrySlot*>& chunk =
+				registry.chunks[index / Registry::chunkSlots];
+			if (chunk.load() == nullptr) {
+				chunk.store(new RegistrySlot[Registry::chunkSlots],
+					std::memory_order_release);
+			}
+		}
+		else {
+			//No more ids.
+			throw std::bad_alloc();
+		}
+		RegistrySlot* slot = registry.slot(index);
+		entry->id = slot->generation << Registry::indexBits | index;
+		unsigned long id = entry->id;
+		slot->entry.store(entry.release(), std::memory_order_release);
+		return id;
+	}
+
+	//Takes the poset with the given id out of the poset_collection,
+	//and returns it, or nullptr if it doesn't exist. The caller must hold
+	//an EpochGuard.
+	PosetEntry* unregisterPoset(unsigned long id) {
+		Registry& registry = poset_collection();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		PosetEntry* entry = findPoset(id);
+		if (entry != nullptr) {
+			RegistrySlot* slot = registry.slot(id & Registry::indexMask);
+			slot->entry.store(nullptr, std::memory_order_release);
+			if (slot->generation < Registry::maxGeneration) {
+				++slot->generation;
+				registry.freeSlots.push_back(id & Registry::indexMask);
+			}
+		}
+		return entry;
+	}
+
+	//Publishes the snapshot of the entry's poset, unless there already is
+	//one. The caller must hold the entry's lock.
+	void publishSnapshot(PosetEntry& entry) {
+		std::unique_lock<std::mutex> lock(entry.snapshotMutex,
+			std::try_to_lock);
+		if (lock.owns_lock() && entry.snapshot.load() == nullptr) {
+			entry.snapshot.store(new Poset(entry.poset),
+				std::memory_order_release);
+		}
+	}
+
+	//Unpublishes the entry's snapshot. The caller must hold the entry's
+	//lock exclusively.
+	void retireSnapshot(PosetEntry& entry) {
+		const Poset* snapshot = entry.snapshot.exchange(nullptr);
+		if (snapshot != nullptr) {
+			retire([snapshot]() { delete snapshot; });
+		}
+	}
+
+	bool promoteMapped(PosetEntry& entry);
+
+	//Read access to the poset with the given id. Uses the snapshot if
+	//there is one, and holds the poset's shared lock otherwise. The poset
+	//stays valid even if it's deleted in the meantime.
+	//If the poset is read in place from its file, callers which can read
+	//the file directly get it as mappedFile(), and others promote it first.
+	class ReadHandle {
+	public:
+		explicit ReadHandle(unsigned long id, bool inPlace = false) :
+			entry(findPoset(id)) {
+			callContext().entry = entry;
+			callContext().id = id;
+			if (entry == nullptr) {
+				return;
+			}
+			else if (const MappedFile* mapped =
+				entry->mapped.load(std::memory_order_acquire)) {
+				if (inPlace) {
+					file = mapped;
+					return;
+				}
+				std::unique_lock<shared_mutex> writeLock(entry->mutex);
+				if (!promoteMapped(*entry)) {
+					//The poset can only be read in place.
+					callContext().entry = nullptr;
+					entry = nullptr;
+					return;
+				}
+			}
+			if (entry->snapshotsEnabled.load(std::memory_order_acquire)) {
+				const Poset* snapshot =
+					entry->snapshot.load(std::memory_order_acquire);
+				if (snapshot != nullptr) {
+					poset = snapshot;
+					return;
+				}
+			}
+			lock = std::shared_lock<shared_mutex>(entry->mutex);
+			poset = &entry->poset;
+			if (entry->snapshotsEnabled.load()) {
+				//Next readers won't have to wait for the lock.
+				publishSnapshot(*entry);
+			}
+		}
+
+		explicit operator bool() const {
+			return poset != nullptr || file != nullptr;
+		}
+
+		const Poset& operator*() const {
+			return *poset;
+		}
+
+		const Poset* operator->() const {
+			return poset;
+		}
+
+		const MappedFile* mappedFile() const {
+			return file;
+		}
+
+		TestCache* testCache() const {
+			return entry->testCache.load(std::memory_order_acquire);
+		}
+
+	private:
+		EpochGuard guard;
+		PosetEntry* entry;
+		const Poset* poset = nullptr;
+		const MappedFile* file = nullptr;
+		std::shared_lock<shared_mutex> lock;
+	};
+
+	//Write access to the poset with the given id, holding its exclusive
+	//lock for as long as the handle lives. If the poset was modified,
+	//its snapshot is retired.
+	class WriteHandle {
+	public:
+		explicit WriteHandle(unsigned long id) : entry(findPoset(id)) {
+			callContext().entry = entry;
+			callContext().id = id;
+			if (entry != nullptr) {
+				lock = std::unique_lock<shared_mutex>(entry->mutex);
+				if (!promoteMapped(*entry)) {
+					//The poset can only be read in place, so it can't
+					//be modified.
+					lock.unlock();
+					callContext().entry = nullptr;
+					entry = nullptr;
+					return;
+				}
+			}
+		}
+
+		~WriteHandle() {
+			if (entry == nullptr) {
+				return;
+			}
+			entry->poset.releaseReplaced();
+			const Poset* snapshot = entry->snapshot.load();
+			if (snapshot != nullptr &&
+				snapshot->generation != entry->poset.generation) {
+				retireSnapshot(*entry);
+			}
+		}
+
+		WriteHandle(const WriteHandle&) = delete;
+		WriteHandle& operator=(const WriteHandle&) = delete;
+
+		explicit operator bool() const {
+			return entry != nullptr;
+		}
+
+		Poset& operator*() const {
+			return entry->poset;
+		}
+
+		Poset* operator->() const {
+			return &entry->poset;
+		}
+
+		PosetEntry& posetEntry() const {
+			return *entry;
+		}
+
+	private:
+		EpochGuard guard;
+		PosetEntry* entry;
+		std::unique_lock<shared_mutex> lock;
+	};
+
+	//Returns the index of the given value, or noElement if the value
+	//isn't in the poset.
+	element_id findElement(const Poset& poset, string_view value) {
+		return poset.ids.find(poset.names, value);
+	}
+
+	//Returns the first word of the given element's closure row.
+	const uint64_t* closureRow(const Poset& poset, element_id element) {
+		return poset.closure[element / ClosureChunk::size].words.data() +
+			element % ClosureChunk::size * poset.closureWords;
+	}
+
+	//Returns the first word of the given element's closure row for writing.
+	uint64_t* editClosureRow(Poset& poset, element_id element) {
+		return poset.closure.edit(element / ClosureChunk::size).words.data() +
+			element % ClosureChunk::size * poset.closureWords;
+	}
+
+	bool closureBit(const uint64_t* row, element_id element) {
+		return (row[element / 64] >> (element % 64)) & 1;
+	}
+
+	void setClosureBit(uint64_t* row, element_id element) {
+		row[element / 64] |= uint64_t(1) << (element % 64);
+	}
+
+	void clearClosureBit(uint64_t* row, element_id element) {
+		row[element / 64] &= ~(uint64_t(1) << (element % 64));
+	}
+
+	//Makes the closure big enough to hold a row and a column for every
+	//index of the poset. Rows are widened geometrically, so appending
+	//elements costs amortised O(n / 64) words each.
+	void reserveClosure(Poset& poset) {
+		size_t size = poset.names.size();
+		if (size > poset.closureWords * 64) {
+			size_t words = std::max<size_t>(1, poset.closureWords);
+			while (size > words * 64) {
+				words *= 2;
+			}
+			SharedChunks<ClosureChunk> widened;
+			for (size_t c = 0; c < poset.closure.size(); ++c) {
+				ClosureChunk* chunk = new ClosureChunk(words);
+				for (size_t i = 0; i < ClosureChunk::size; ++i) {
+					std::copy_n(poset.closure[c].words.begin() +
+						i * poset.closureWords, poset.closureWords,
+						chunk->words.begin() + i * words);
+				}
+				widened.append(chunk);
+			}
+			poset.closure = std::move(widened);
+			poset.closureWords = words;
+		}
+		while (poset.closure.size() * ClosureChunk::size < size) {
+			poset.closure.append(new ClosureChunk(poset.closureWords));
+		}
+	}
+
+	//Ors the row src into dst. Short rows are merged inline, as calling
+	//a vector kernel would take longer than the loop.
+	void orRow(uint64_t* dst, const uint64_t* src, size_t words) {
+		if (words < 8) {
+			for (size_t w = 0; w < words; ++w) {
+				dst[w] |= src[w];
+			}
+		}
+		else {
+			bitsetKernels().orWords(dst, src, words);
+		}
+	}
+
+	//Ors the rows of the element's children, and the children themselves,
+	//into the element's row.
+	void mergeChildRows(Poset& poset, element_id element) {
+		uint64_t* row = editClosureRow(poset, element);
+		for (element_id child : poset.children[element]) {
+			orRow(row, closureRow(poset, child), poset.closureWords);
+			setClosureBit(row, child);
+		}
+	}
+
+	//Lets the threads wait for each other. Waiting threads spin, as they
+	//usually wait only for a short level to be merged.
+	class SpinBarrier {
+	public:
+		explicit SpinBarrier(size_t threads) : threads(threads) {
+		}
+
+		void wait() {
+			size_t current = phase.load(std::memory_order_acquire);
+			if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == threads) {
+				arrived.store(0, std::memory_order_relaxed);
+				phase.fetch_add(1, std::memory_order_release);
+			}
+			else {
+				while (phase.load(std::memory_order_acquire) == current) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		size_t threads;
+		std::atomic<size_t> arrived{ 0 };
+		std::atomic<size_t> phase{ 0 };
+	};
+
+	//Merges the rows level by level, splitting every big level between
+	//the threads. Elements of a level have children only in the lower
+	//levels, so their rows can be merged in any order. Runs of small
+	//levels are merged by a single thread, so the threads meet only
+	//around the levels worth splitting.
+	void mergeLevels(Poset& poset, const vector<element_id>& elements,
+		const vector<size_t>& levelStart, size_t threads) {
+		size_t constexpr minimalLevel = 256;
+		size_t constexpr slice = 16;
+		size_t height = levelStart.size() - 1;
+		auto isSmall = [&](size_t level) {
+			return levelStart[level + 1] - levelStart[level] < minimalLevel;
+		};
+		unique_ptr<std::atomic<size_t>[]> claimed(
+			new std::atomic<size_t>[height]());
+		SpinBarrier barrier(threads);
+		auto work = [&](size_t thread) {
+			size_t level = 0;
+			while (level < height) {
+				if (isSmall(level)) {
+					size_t last = level;
+					while (last < height && isSmall(last)) {
+						++last;
+					}
+					if (thread == 0) {
+						for (size_t i = levelStart[level]; i < levelStart[last];
+							++i) {
+							mergeChildRows(poset, elements[i]);
+						}
+					}
+					level = last;
+				}
+				else {
+					size_t first;
+					while ((first = levelStart[level] +
+						claimed[level].fetch_add(slice)) < levelStart[level + 1]) {
+						size_t last = std::min(first + slice,
+							levelStart[level + 1]);
+						for (size_t i = first; i < last; ++i) {
+							mergeChildRows(poset, elements[i]);
+						}
+					}
+					++level;
+				}
+				barrier.wait();
+			}
+		};
+		vector<std::thread> workers;
+		for (size_t thread = 1; thread < threads; ++thread) {
+			workers.emplace_back(work, thread);
+		}
+		work(0);
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	//Computes the closure from scratch, processing the elements in
+	//reverse topological order, so every row is the union of the rows
+	//of its children. With more threads, the elements are grouped into
+	//levels by their distance from the maximal elements first.
+	void buildClosure(Poset& poset, size_t threads = 1) {
+		poset.closure.clear();
+		poset.closureWords = 0;
+		reserveClosure(poset);
+
+		size_t size = poset.names.size();
+		vector<element_id> order;
+		vector<size_t> pending(size);
+		vector<size_t> levels(threads > 1 ? size : 0);
+		order.reserve(size);
+		for (element_id e = 0; e < size; ++e) {
+			pending[e] = poset.children[e].size();
+			if (poset.names[e].data() != nullptr && pending[e] == 0) {
+				order.push_back(e);
+			}
+		}
+		size_t height = 0;
+		for (size_t i = 0; i < order.size(); ++i) {
+			element_id e = order[i];
+			if (threads > 1) {
+				height = std::max(height, levels[e] + 1);
+			}
+			else {
+				mergeChildRows(poset, e);
+			}
+			for (element_id parent : poset.parents[e]) {
+				if (threads > 1) {
+					levels[parent] = std::max(levels[parent], levels[e] + 1);
+				}
+				if (--pending[parent] == 0) {
+					order.push_back(parent);
+				}
+			}
+		}
+		if (threads <= 1) {
+			return;
+		}
+
+		//Sorts the elements by their levels.
+		vector<size_t> levelStart(height + 1, 0);
+		for (element_id e : order) {
+			++levelStart[levels[e] + 1];
+		}
+		for (size_t level = 1; level <= height; ++level) {
+			levelStart[level] += levelStart[level - 1];
+		}
+		vector<element_id> elements(order.size());
+		vector<size_t> filled(levelStart.begin(), levelStart.end() - 1);
+		for (element_id e : order) {
+			elements[filled[levels[e]]++] = e;
+		}
+		mergeLevels(poset, elements, levelStart, threads);
+	}
+
+	//Updates the closure after adding the relation value1->value2:
+	//value1 and all its parents become parents of value2 and everything
+	//after it.
+	void addToClosure(Poset& poset, element_id value1, element_id value2) {
+		for (element_id e = 0; e < poset.names.size(); ++e) {
+			if (e == value1 || closureBit(closureRow(poset, e), value1)) {
+				//The row of value2 isn't modified, as it can't be after
+				//value2 itself.
+				uint64_t* row = editClosureRow(poset, e);
+				orRow(row, closureRow(poset, value2), poset.closureWords);
+				setClosureBit(row, value2);
+			}
+		}
+	}
+
+	//Clears the row and the column of the removed element. Only the rows
+	//which have the element's bit set are written.
+	void removeFromClosure(Poset& poset, element_id element) {
+		std::fill_n(editClosureRow(poset, element), poset.closureWords, 0);
+		for (element_id e = 0; e < poset.names.size(); ++e) {
+			if (closureBit(closureRow(poset, e), element)) {
+				clearClosureBit(editClosureRow(poset, e), element);
+			}
+		}
+	}
+
+	//Computes the linear extension from scratch, with Kahn's algorithm.
+	void buildExtension(Poset& poset) {
+		size_t size = poset.names.size();
+		poset.extension.clear();
+		poset.extensionRank.clear();
+		poset.extensionRank.resize(size);
+		poset.extensionHoles = 0;
+		vector<size_t> pending(size);
+		for (element_id e = 0; e < size; ++e) {
+			pending[e] = poset.parents[e].size();
+			if (poset.names[e].data() != nullptr && pending[e] == 0) {
+				poset.extension.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < poset.extension.size(); ++i) {
+			poset.extensionRank.edit(poset.extension[i]) =
+				static_cast<uint32_t>(i);
+			for (element_id child : poset.children[poset.extension[i]]) {
+				if (--pending[child] == 0) {
+					poset.extension.push_back(child);
+				}
+			}
+		}
+		poset.extensionValid = true;
+	}
+
+	//Closes the holes of the extension, once they take most of it.
+	void compactExtension(Poset& poset) {
+		if (poset.extensionHoles * 2 <= poset.extension.size()) {
+			return;
+		}
+		size_t rank = 0;
+		for (element_id e : poset.extension) {
+			if (e != noElement) {
+				poset.extensionRank.edit(e) = static_cast<uint32_t>(rank);
+				poset.extension.edit(rank++) = e;
+			}
+		}
+		poset.extension.resize(rank);
+		poset.extensionHoles = 0;
+	}
+
+	//Interns the given value, which isn't in the poset yet,
+	//and returns its index.
+	element_id insertElement(Poset& poset, string_view value) {
+		element_id index;
+		if (!poset.freeIds.empty()) {
+			index = poset.freeIds.back();
+			poset.freeIds.pop_back();
+		}
+		else {
+			index = static_cast<element_id>(poset.names.size());
+			poset.names.resize(index + 1);
+			poset.children.resize(index + 1);
+			poset.parents.resize(index + 1);
+		}
+		poset.names.assign(index, value);
+		poset.ids.insert(value, index);
+		poset.minimal.insert(index);
+		poset.maximal.insert(index);
+		++poset.generation;
+		if (poset.closureEnabled) {
+			reserveClosure(poset);
+		}
+		if (poset.extensionValid) {
+			//Unrelated to anything, so it can go anywhere.
+			if (poset.extensionRank.size() <= index) {
+				poset.extensionRank.resize(index + 1);
+			}
+			poset.extensionRank.edit(index) =
+				static_cast<uint32_t>(poset.extension.size());
+			poset.extension.push_back(index);
+		}
+		return index;
+	}
+
+	//Checks whether the given index is in the list.
+	bool findIndex(const element_list& list, element_id index) {
+		for (element_id e : list) {
+			if (e == index) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Deletes the given index from the list. Returns false if it wasn't
+	//there. The order of the list isn't preserved.
+	bool eraseIndex(element_list& list, element_id index) {
+		for (size_t i = 0; i < list.size(); ++i) {
+			if (list[i] == index) {
+				list[i] = list.back();
+				list.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Removes the given element together with all its relations
+	//and frees its index.
+	void eraseElement(Poset& poset, element_id element) {
+		if (poset.closureEnabled) {
+			removeFromClosure(poset, element);
+		}
+		for (element_id child : poset.children[element]) {
+			eraseIndex(poset.parents.edit(child), element);
+			if (poset.parents[child].empty()) {
+				poset.minimal.insert(child);
+			}
+		}
+		for (element_id parent : poset.parents[element]) {
+			eraseIndex(poset.children.edit(parent), element);
+			if (poset.children[parent].empty()) {
+				poset.maximal.insert(parent);
+			}
+		}
+		if (poset.minimal.contains(element)) {
+			poset.minimal.erase(element);
+		}
+		if (poset.maximal.contains(element)) {
+			poset.maximal.erase(element);
+		}
+		poset.ids.erase(poset.names[element], element);
+		poset.names.reset(element);
+		poset.children.reset(element);
+		poset.parents.reset(element);
+		poset.freeIds.push_back(element);
+		++poset.generation;
+		if (poset.extensionValid) {
+			//The rest of the extension stays in order.
+			poset.extension.edit(poset.extensionRank[element]) = noElement;
+			++poset.extensionHoles;
+			compactExtension(poset);
+		}
+	}
+
+	//Adds the relation parent->child, which mustn't be there yet.
+	//Relations implied by the others keep the linear extension in order,
+	//and new ones are ordered by insertRelation first, so the extension
+	//is dropped only if a batch links relations out of its order.
+	void linkChild(Poset& poset, element_id parent, element_id child) {
+		if (poset.children[parent].empty()) {
+			poset.maximal.erase(parent);
+		}
+		if (poset.parents[child].empty()) {
+			poset.minimal.erase(child);
+		}
+		poset.children.edit(parent).push_back(child);
+		poset.parents.edit(child).push_back(parent);
+		++poset.generation;
+		if (poset.extensionValid &&
+			poset.extensionRank[parent] > poset.extensionRank[child]) {
+			poset.extensionValid = false;
+		}
+	}
+
+	//Adds the relation parent->child, unless it's already there.
+	void insertChild(Poset& poset, element_id parent, element_id child) {
+		if (!findIndex(poset.children[parent], child)) {
+			linkChild(poset, parent, child);
+		}
+	}
+
+	//Deletes the relation parent->child. Returns false if there was
+	//no such relation.
+	bool eraseChild(Poset& poset, element_id parent, element_id child) {
+		if (findIndex(poset.children[parent], child)) {
+			eraseIndex(poset.children.edit(parent), child);
+			eraseIndex(poset.parents.edit(child), parent);
+			if (poset.children[parent].empty()) {
+				poset.maximal.insert(parent);
+			}
+			if (poset.parents[child].empty()) {
+				poset.minimal.insert(child);
+			}
+			++poset.generation;
+			return true;
+		}
+		return false;
+	}
+
+	//Checks whether parent is directly before child in the relation.
+	bool findChild(const Poset& poset, element_id parent, element_id child) {
+		return findIndex(poset.children[parent], child);
+	}
+
+	//Per-thread scratch space of findParent. Elements are marked as
+	//visited by stamping them with the current search epoch, so the marks
+	//never have to be cleared between searches.
+	struct SearchState {
+		vector<uint32_t> stamps;
+		uint32_t epoch = 0;
+		vector<element_id> forward;
+		vector<element_id> backward;
+		vector<element_id> next;
+		vector<uint32_t> counters;
+		//Second pair of searches run by searchOrder, from the value2 down
+		//and from the value1 up, with its own stamps.
+		vector<uint32_t> reverseStamps;
+		vector<element_id> reverseForward;
+		vector<element_id> reverseBackward;
+		//Work done by findParent on this thread so far.
+		uint64_t searches = 0;
+		uint64_t nodesVisited = 0;
+		uint64_t edgesScanned = 0;
+		//Answers of poset_test found in the caches on this thread so far,
+		//and the ones which weren't there.
+		uint64_t cacheHits = 0;
+		uint64_t cacheMisses = 0;
+	};
+
+	SearchState& searchState() {
+		thread_local SearchState state;
+		return state;
+	}
+
+	//Measures a single API call, adds it to the statistics of the poset
+	//it used and to the global ones, and traces it if tracing is on.
+	//If the call isn't finished explicitly, it counts as successful
+	//if the poset existed.
+	class CallRecorder {
+	public:
+		explicit CallRecorder(cxx::poset_op op) : op(op),
+			search(searchState()), searches(search.searches),
+			nodesVisited(search.nodesVisited),
+			edgesScanned(search.edgesScanned), cacheHits(search.cacheHits),
+			cacheMisses(search.cacheMisses),
+			start(std::chrono::steady_clock::now()) {
+			callContext() = CallContext{ nullptr, 0, POSET_TRACE_NO_ELEMENT,
+				POSET_TRACE_NO_ELEMENT };
+		}
+
+		~CallRecorder() {
+			if (!finished) {
+				finish(callContext().entry != nullptr);
+			}
+		}
+
+		CallRecorder(const CallRecorder&) = delete;
+		CallRecorder& operator=(const CallRecorder&) = delete;
+
+		//Records a single call with the given result, and returns it.
+		bool finish(bool success) {
+			record(1, success ? 1 : 0, true);
+			return success;
+		}
+
+		//Records a batch of calls. Batches have no latency samples.
+		size_t finishBatch(size_t count, size_t successes) {
+			record(count, successes, false);
+			return successes;
+		}
+
+	private:
+		void record(uint64_t calls, uint64_t successes, bool sample) {
+			finished = true;
+			uint64_t ns = static_cast<uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count());
+			size_t bucket = 0;
+			while (bucket + 1 < POSET_LATENCY_BUCKETS && (ns >> (bucket + 1))) {
+				++bucket;
+			}
+			if (traceEnabled().load(std::memory_order_relaxed)) {
+				traceCall(static_cast<uint64_t>(
+					std::chrono::duration_cast<std::chrono::nanoseconds>(
+						start.time_since_epoch()).count()),
+					op, successes != 0);
+			}
+			//The entry is kept alive by the guard of the handle's epoch.
+			PosetEntry* entry = callContext().entry;
+			StatsCounters* targets[] = { &threadStats(),
+				entry != nullptr ? &entry->stats : nullptr };
+			for (StatsCounters* counters : targets) {
+				if (counters == nullptr) {
+					continue;
+				}
+				bool shared = counters != targets[0];
+				OpCounters& opCounters = counters->ops[op];
+				addCounter(opCounters.calls, calls, shared);
+				addCounter(opCounters.successes, successes, shared);
+				addCounter(opCounters.failures, calls - successes, shared);
+				addCounter(opCounters.totalNs, ns, shared);
+				if (sample) {
+					addCounter(opCounters.latency[bucket], 1, shared);
+				}
+				if (search.searches != searches) {
+					addCounter(counters->searches,
+						search.searches - searches, shared);
+					addCounter(counters->nodesVisited,
+						search.nodesVisited - nodesVisited, shared);
+					addCounter(counters->edgesScanned,
+						search.edgesScanned - edgesScanned, shared);
+				}
+				if (search.cacheHits != cacheHits ||
+					search.cacheMisses != cacheMisses) {
+					addCounter(counters->cacheHits,
+						search.cacheHits - cacheHits, shared);
+					addCounter(counters->cacheMisses,
+						search.cacheMisses - cacheMisses, shared);
+				}
+			}
+		}
+
+		//Keeps the poset found by the call alive until it's recorded.
+		EpochGuard guard;
+		cxx::poset_op op;
+		const SearchState& search;
+		uint64_t searches;
+		uint64_t nodesVisited;
+		uint64_t edgesScanned;
+		uint64_t cacheHits;
+		uint64_t cacheMisses;
+		std::chrono::steady_clock::time_point start;
+		bool finished = false;
+	};
+
+	//Starts a new search over a poset with the given number of indices.
+	//Each search uses two stamps: epoch for elements reached from the
+	//start, and epoch + 1 for elements reached from the goal.
+	void beginSearch(SearchState& state, size_t size) {
+		if (state.stamps.size() < size) {
+			state.stamps.resize(size, 0);
+			state.counters.resize(size, 0);
+		}
+		if (state.epoch >= UINT32_MAX - 2) {
+			//Stamps would wrap around, so old marks could be mistaken
+			//for the new ones.
+			std::fill(state.stamps.begin(), state.stamps.end(), 0);
+			std::fill(state.reverseStamps.begin(), state.reverseStamps.end(), 0);
+			state.epoch = 0;
+		}
+		state.epoch += 2;
+		state.forward.clear();
+		state.backward.clear();
+	}
+
+	//Moves the frontier one step along the given adjacency. Returns true
+	//if it reached an element already visited from the other side.
+	template <typename Adjacency>
+	bool expandFrontier(SearchState& state, vector<uint32_t>& stamps,
+		const Adjacency& adjacency, vector<element_id>& frontier, uint32_t own,
+		uint32_t other) {
+		state.next.clear();
+		for (element_id e : frontier) {
+			auto&& row = adjacency[e];
+			++state.nodesVisited;
+			state.edgesScanned += row.size();
+			for (element_id e2 : row) {
+				if (stamps[e2] == other) {
+					return true;
+				}
+				else if (stamps[e2] != own) {
+					stamps[e2] = own;
+					state.next.push_back(e2);
+				}
+			}
+		}
+		frontier.swap(state.next);
+		return false;
+	}
+
+	//Checks whether the value1 is the parent of the value2 in the relation
+	//given by both its adjacencies, over size indices.
+	//Said operation is realised as a bidirectional BFS: it walks down
+	//from the value1 and up from the value2, always expanding the smaller
+	//frontier, until both searches meet or one of them runs out.
+	template <typename Adjacency>
+	bool searchParent(size_t size, const Adjacency& children,
+		const Adjacency& parents, element_id value1, element_id value2) {
+		if (value1 == value2) {
+			//Relation is acyclic, so no element is its own parent.
+			return false;
+		}
+
+		SearchState& state = searchState();
+		beginSearch(state, size);
+		++state.searches;
+		uint32_t forwardStamp = state.epoch;
+		uint32_t backwardStamp = state.epoch + 1;
+		state.stamps[value1] = forwardStamp;
+		state.stamps[value2] = backwardStamp;
+		state.forward.push_back(value1);
+		state.backward.push_back(value2);
+
+		while (!state.forward.empty() && !state.backward.empty()) {
+			bool met;
+			if (state.forward.size() <= state.backward.size()) {
+				met = expandFrontier(state, state.stamps, children,
+					state.forward, forwardStamp, backwardStamp);
+			}
+			else {
+				met = expandFrontier(state, state.stamps, parents,
+					state.backward, backwardStamp, forwardStamp);
+			}
+			if (met) {
+				//value1 is the parent of the value2.
+				return true;
+			}
+		}
+		//One of the searches ran out, so value1 is not a parent of value2.
+		return false;
+	}
+
+	//Compares the value1 with the value2 in the relation given by both its
+	//adjacencies, over size indices, in a single traversal.
+	//It runs the searches of searchParent for both directions at once,
+	//always expanding the smallest of their four frontiers. As the relation
+	//is acyclic, the first meeting settles the answer, and the traversal
+	//ends once both searches met or ran out.
+	template <typename Adjacency>
+	cxx::poset_order searchOrder(size_t size, const Adjacency& children,
+		const Adjacency& parents, element_id value1, element_id value2) {
+		if (value1 == value2) {
+			return cxx::POSET_EQUAL;
+		}
+
+		SearchState& state = searchState();
+		beginSearch(state, size);
+		if (state.reverseStamps.size() < size) {
+			state.reverseStamps.resize(size, 0);
+		}
+		state.reverseForward.clear();
+		state.reverseBackward.clear();
+		++state.searches;
+		uint32_t forwardStamp = state.epoch;
+		uint32_t backwardStamp = state.epoch + 1;
+		//Stamps search for the value1 before the value2, and the reverse
+		//stamps for the value2 before the value1.
+		state.stamps[value1] = forwardStamp;
+		state.stamps[value2] = backwardStamp;
+		state.forward.push_back(value1);
+		state.backward.push_back(value2);
+		state.reverseStamps[value2] = forwardStamp;
+		state.reverseStamps[value1] = backwardStamp;
+		state.reverseForward.push_back(value2);
+		state.reverseBackward.push_back(value1);
+
+		bool less = true;
+		bool greater = true;
+		while (less || greater) {
+			vector<element_id>* frontier = nullptr;
+			if (less) {
+				frontier = state.forward.size() <= state.backward.size() ?
+					&state.forward : &state.backward;
+			}
+			if (greater) {
+				vector<element_id>* reverse =
+					state.reverseForward.size() <= state.reverseBackward.size() ?
+					&state.reverseForward : &state.reverseBackward;
+				if (frontier == nullptr || reverse->size() < frontier->size()) {
+					frontier = reverse;
+				}
+			}
+
+			bool met;
+			if (frontier == &state.forward) {
+				met = expandFrontier(state, state.stamps, children,
+					state.forward, forwardStamp, backwardStamp);
+			}
+			else if (frontier == &state.backward) {
+				met = expandFrontier(state, state.stamps, parents,
+					state.backward, backwardStamp, forwardStamp);
+			}
+			else if (frontier == &state.reverseForward) {
+				met = expandFrontier(state, state.reverseStamps, children,
+					state.reverseForward, forwardStamp, backwardStamp);
+			}
+			else {
+				met = expandFrontier(state, state.reverseStamps, parents,
+					state.reverseBackward, backwardStamp, forwardStamp);
+			}
+
+			bool forwardSide = frontier == &state.forward ||
+				frontier == &state.backward;
+			if (met) {
+				return forwardSide ? cxx::POSET_LESS : cxx::POSET_GREATER;
+			}
+			else if (frontier->empty()) {
+				//This direction's search ran out.
+				(forwardSide ? less : greater) = false;
+			}
+		}
+		return cxx::POSET_INCOMPARABLE;
+	}
+
+	//Checks whether the value1 is the parent of the value2.
+	bool findParent(const Poset& poset, element_id value1,
+		element_id value2) {
+		return searchParent(poset.names.size(), poset.children, poset.parents,
+			value1, value2);
+	}
+
+	//Adds parent->child, which the relation still implies, back as
+	//a relation after some path between them was broken. In the reduction
+	//mode it's added only if no other path leads from the parent
+	//to the child.
+	void relinkChild(Poset& poset, element_id parent, element_id child) {
+		if (!poset.reductionEnabled) {
+			insertChild(poset, parent, child);
+		}
+		else if (!findParent(poset, parent, child)) {
+			linkChild(poset, parent, child);
+		}
+	}
+
+	//Checks whether the value1 is the parent of the value2, using
+	//the closure if the poset keeps one.
+	bool isBefore(const Poset& poset, element_id value1, element_id value2) {
+		if (poset.closureEnabled) {
+			return closureBit(closureRow(poset, value1), value2);
+		}
+		else {
+			return findParent(poset, value1, value2);
+		}
+	}
+
+	//Compares the value1 with the value2, using the closure if the poset
+	//keeps one.
+	cxx::poset_order compareElements(const Poset& poset, element_id value1,
+		element_id value2) {
+		if (!poset.closureEnabled) {
+			return searchOrder(poset.names.size(), poset.children,
+				poset.parents, value1, value2);
+		}
+		else if (value1 == value2) {
+			return cxx::POSET_EQUAL;
+		}
+		else if (closureBit(closureRow(poset, value1), value2)) {
+			return cxx::POSET_LESS;
+		}
+		else if (closureBit(closureRow(poset, value2), value1)) {
+			return cxx::POSET_GREATER;
+		}
+		else {
+			return cxx::POSET_INCOMPARABLE;
+		}
+	}
+
+	//Deletes the relations made redundant by the new relation
+	//value1->value2: every relation from value1 or its parents to value2
+	//or its children becomes implied by the path through the new one.
+	void pruneRelations(Poset& poset, element_id value1, element_id value2) {
+		SearchState& state = searchState();
+		beginSearch(state, poset.names.size());
+		uint32_t below = state.epoch;
+		uint32_t above = state.epoch + 1;
+		state.stamps[value2] = below;
+		state.forward.push_back(value2);
+		for (size_t i = 0; i < state.forward.size(); ++i) {
+			for (element_id child : poset.children[state.forward[i]]) {
+				if (state.stamps[child] != below) {
+					state.stamps[child] = below;
+					state.forward.push_back(child);
+				}
+			}
+		}
+		state.stamps[value1] = above;
+		state.backward.push_back(value1);
+		for (size_t i = 0; i < state.backward.size(); ++i) {
+			for (element_id parent : poset.parents[state.backward[i]]) {
+				if (state.stamps[parent] != above) {
+					state.stamps[parent] = above;
+					state.backward.push_back(parent);
+				}
+			}
+		}
+
+		//The rows are looked up again after every deletion, which may copy
+		//them.
+		for (element_id parent : state.backward) {
+			for (size_t i = 0; i < poset.children[parent].size();) {
+				element_id child = poset.children[parent][i];
+				if (state.stamps[child] == below) {
+					eraseChild(poset, parent, child);
+				}
+				else {
+					++i;
+				}
+			}
+		}
+	}
+
+	//Moves the elements of the linear extension, so that value1 comes
+	//before value2 (Pearce-Kelly dynamic topological order). Only
+	//the elements ranked between them can get out of order: value2 with
+	//the elements after it, and value1 with the elements before it.
+	//The latter are moved in front of the former, taking the same ranks
+	//as both groups had together.
+	void reorderExtension(Poset& poset, element_id value1, element_id value2) {
+		uint32_t lower = poset.extensionRank[value2];
+		uint32_t upper = poset.extensionRank[value1];
+		if (lower > upper) {
+			return;
+		}
+
+		SearchState& state = searchState();
+		beginSearch(state, poset.names.size());
+		uint32_t after = state.epoch;
+		uint32_t before = state.epoch + 1;
+		state.stamps[value2] = after;
+		state.forward.push_back(value2);
+		for (size_t i = 0; i < state.forward.size(); ++i) {
+			for (element_id child : poset.children[state.forward[i]]) {
+				if (state.stamps[child] != after &&
+					poset.extensionRank[child] < upper) {
+					state.stamps[child] = after;
+					state.forward.push_back(child);
+				}
+			}
+		}
+		state.stamps[value1] = before;
+		state.backward.push_back(value1);
+		for (size_t i = 0; i < state.backward.size(); ++i) {
+			for (element_id parent : poset.parents[state.backward[i]]) {
+				if (state.stamps[parent] != before &&
+					poset.extensionRank[parent] > lower) {
+					state.stamps[parent] = before;
+					state.backward.push_back(parent);
+				}
+			}
+		}
+
+		auto byRank = [&](element_id a, element_id b) {
+			return poset.extensionRank[a] < poset.extensionRank[b];
+		};
+		std::sort(state.forward.begin(), state.forward.end(), byRank);
+		std::sort(state.backward.begin(), state.backward.end(), byRank);
+		state.next.clear();
+		for (element_id e : state.backward) {
+			state.next.push_back(poset.extensionRank[e]);
+		}
+		for (element_id e : state.forward) {
+			state.next.push_back(poset.extensionRank[e]);
+		}
+		std::sort(state.next.begin(), state.next.end());
+		size_t slot = 0;
+		for (const vector<element_id>* group : { &state.backward,
+			&state.forward }) {
+			for (element_id e : *group) {
+				poset.extensionRank.edit(e) = state.next[slot];
+				poset.extension.edit(state.next[slot]) = e;
+				++slot;
+			}
+		}
+	}
+
+	//Adds the relation value1->value2, which keeps the poset acyclic
+	//and isn't implied by the other relations yet.
+	void insertRelation(Poset& poset, element_id value1, element_id value2) {
+		if (poset.extensionValid) {
+			reorderExtension(poset, value1, value2);
+		}
+		if (poset.reductionEnabled) {
+			pruneRelations(poset, value1, value2);
+		}
+		linkChild(poset, value1, value2);
+		if (poset.closureEnabled) {
+			addToClosure(poset, value1, value2);
+		}
+	}
+
+	//Adds the relation value1->value2 if it's neither already there nor
+	//would it create a cycle. Returns whether it was added.
+	bool tryInsertRelation(Poset& poset, element_id value1,
+		element_id value2) {
+		if (compareElements(poset, value1, value2) !=
+			cxx::POSET_INCOMPARABLE) {
+			return false;
+		}
+		insertRelation(poset, value1, value2);
+		return true;
+	}
+
+	//Checks whether the relations reachable from the given elements
+	//contain a cycle. Every cycle created by new relations passes through
+	//their children, so it's enough to topologically sort the part of
+	//the poset below them.
+	bool findCycle(const Poset& poset, const vector<element_id>& sources) {
+		SearchState& state = searchState();
+		beginSearch(state, poset.names.size());
+		uint32_t reached = state.epoch;
+		for (element_id e : sources) {
+			if (state.stamps[e] != reached) {
+				state.stamps[e] = reached;
+				state.forward.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < state.forward.size(); ++i) {
+			for (element_id child : poset.children[state.forward[i]]) {
+				if (state.stamps[child] != reached) {
+					state.stamps[child] = reached;
+					state.forward.push_back(child);
+				}
+			}
+		}
+
+		//Kahn's algorithm restricted to the reached elements.
+		state.backward.clear();
+		for (element_id e : state.forward) {
+			state.counters[e] = 0;
+			for (element_id parent : poset.parents[e]) {
+				if (state.stamps[parent] == reached) {
+					++state.counters[e];
+				}
+			}
+			if (state.counters[e] == 0) {
+				state.backward.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < state.backward.size(); ++i) {
+			for (element_id child : poset.children[state.backward[i]]) {
+				if (--state.counters[child] == 0) {
+					state.backward.push_back(child);
+				}
+			}
+		}
+		return state.backward.size() != state.forward.size();
+	}
+
+	//Computes the transitive reduction: deletes every relation u->v
+	//for which another path leads from u to v. Returns the number
+	//of deleted relations.
+	size_t reducePoset(Poset& poset) {
+		size_t size = poset.names.size();
+		//Ranks in a topological order. Every path goes to higher ranks,
+		//so a search for the children of u can skip everything ranked
+		//after the last of them.
+		vector<element_id> order;
+		vector<size_t> rank(size, 0);
+		vector<size_t> pending(size);
+		order.reserve(size);
+		for (element_id e = 0; e < size; ++e) {
+			pending[e] = poset.parents[e].size();
+			if (poset.names[e].data() != nullptr && pending[e] == 0) {
+				order.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < order.size(); ++i) {
+			rank[order[i]] = i;
+			for (element_id child : poset.children[order[i]]) {
+				if (--pending[child] == 0) {
+					order.push_back(child);
+				}
+			}
+		}
+
+		//Elements stamped with the current search were reached through
+		//at least one other element.
+		vector<size_t> stamps(size, SIZE_MAX);
+		vector<element_id> queue;
+		vector<element_id> redundant;
+		size_t removed = 0;
+		for (element_id u = 0; u < size; ++u) {
+			const element_list& children = poset.children[u];
+			if (children.size() < 2) {
+				continue;
+			}
+			size_t last = 0;
+			for (element_id v : children) {
+				last = std::max(last, rank[v]);
+			}
+			queue.assign(children.begin(), children.end());
+			for (size_t i = 0; i < queue.size(); ++i) {
+				if (rank[queue[i]] >= last) {
+					continue;
+				}
+				for (element_id next : poset.children[queue[i]]) {
+					if (stamps[next] != u) {
+						stamps[next] = u;
+						queue.push_back(next);
+					}
+				}
+			}
+			redundant.clear();
+			for (element_id v : children) {
+				if (stamps[v] == u) {
+					redundant.push_back(v);
+				}
+			}
+			for (element_id v : redundant) {
+				eraseChild(poset, u, v);
+			}
+			removed += redundant.size();
+		}
+		return removed;
+	}
+
+	//Resolves the values which are already in the poset. Big batches are
+	//split between several threads, which only read the poset.
+	void resolveValues(const Poset& poset, size_t count,
+		char const* const* values, vector<element_id>& elements) {
+		elements.resize(count);
+		auto resolve = [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				elements[i] = findElement(poset, values[i]);
+			}
+		};
+		size_t constexpr minimalSlice = 1 << 16;
+		size_t threads = std::min<size_t>(std::thread::hardware_concurrency(),
+			count / minimalSlice);
+		if (threads <= 1) {
+			resolve(0, count);
+			return;
+		}
+		vector<std::thread> workers;
+		size_t slice = (count + threads - 1) / threads;
+		for (size_t first = slice; first < count; first += slice) {
+			workers.emplace_back(resolve, first, std::min(count, first + slice));
+		}
+		resolve(0, slice);
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	//Relation of a bulk load, and the index at which it was given.
+	struct BulkEdge {
+		element_id parent;
+		element_id child;
+		size_t index;
+	};
+
+	//Adds all the given relations at once, inserting the values which
+	//aren't in the poset yet. Duplicated relations, relations of a value
+	//with itself, and relations which are already there are skipped.
+	//The relations are checked for cycles together with the poset by
+	//a single topological sort, before anything is changed. If there is
+	//a cycle, leaves the poset unchanged, stores the indices of the given
+	//relations along it in cycle, and returns false.
+	bool addEdges(Poset& poset, size_t count, char const* const* values1,
+		char const* const* values2, size_t& added, vector<size_t>& cycle) {
+		vector<element_id> elements1;
+		vector<element_id> elements2;
+		resolveValues(poset, count, values1, elements1);
+		resolveValues(poset, count, values2, elements2);
+
+		//New values get provisional indices from the poset's size up.
+		element_id base = static_cast<element_id>(poset.names.size());
+		unordered_map<string_view, element_id> pending;
+		vector<string_view> newValues;
+		auto provisional = [&](element_id& element, char const* value) {
+			if (element == noElement) {
+				auto valueIter = pending.emplace(value,
+					static_cast<element_id>(base + newValues.size())).first;
+				if (valueIter->second == base + newValues.size()) {
+					newValues.push_back(valueIter->first);
+				}
+				element = valueIter->second;
+			}
+		};
+		vector<BulkEdge> edges;
+		edges.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			provisional(elements1[i], values1[i]);
+			provisional(elements2[i], values2[i]);
+			if (elements1[i] != elements2[i]) {
+				edges.push_back(BulkEdge{ elements1[i], elements2[i], i });
+			}
+		}
+		size_t size = base + newValues.size();
+
+		//Drop the duplicates, keeping the first of them, and the relations
+		//which are already in the poset.
+		std::sort(edges.begin(), edges.end(),
+			[](const BulkEdge& a, const BulkEdge& b) {
+				return a.parent != b.parent ? a.parent < b.parent :
+					a.child != b.child ? a.child < b.child : a.index < b.index;
+			});
+		vector<size_t> marks(size, SIZE_MAX);
+		size_t kept = 0;
+		for (size_t i = 0; i < edges.size(); ++i) {
+			const BulkEdge& edge = edges[i];
+			if (i == 0 || edge.parent != edges[i - 1].parent) {
+				if (edge.parent < base) {
+					for (element_id child : poset.children[edge.parent]) {
+						marks[child] = edge.parent;
+					}
+				}
+			}
+			else if (edge.child == edges[i - 1].child) {
+				continue;
+			}
+			if (marks[edge.child] != edge.parent) {
+				edges[kept++] = edge;
+			}
+		}
+		edges.resize(kept);
+
+		//Both adjacencies of the new relations as compressed sparse rows.
+		vector<size_t> childRows(size + 1, 0);
+		vector<size_t> parentRows(size + 1, 0);
+		for (const BulkEdge& edge : edges) {
+			++childRows[edge.parent + 1];
+			++parentRows[edge.child + 1];
+		}
+		for (size_t e = 0; e < size; ++e) {
+			childRows[e + 1] += childRows[e];
+			parentRows[e + 1] += parentRows[e];
+		}
+		vector<size_t> newParents(edges.size());
+		vector<size_t> fill(parentRows.begin(), parentRows.end() - 1);
+		for (size_t i = 0; i < edges.size(); ++i) {
+			newParents[fill[edges[i].child]++] = i;
+		}
+		auto forEachChild = [&](element_id e, auto&& f) {
+			if (e < base) {
+				for (element_id child : poset.children[e]) {
+					f(child, SIZE_MAX);
+				}
+			}
+			for (size_t i = childRows[e]; i < childRows[e + 1]; ++i) {
+				f(edges[i].child, i);
+			}
+		};
+		auto forEachParent = [&](element_id e, auto&& f) {
+			if (e < base) {
+				for (element_id parent : poset.parents[e]) {
+					f(parent, SIZE_MAX);
+				}
+			}
+			for (size_t i = parentRows[e]; i < parentRows[e + 1]; ++i) {
+				f(edges[newParents[i]].parent, newParents[i]);
+			}
+		};
+
+		//Every cycle passes through a new relation, so it's enough
+		//to sort the part of the poset below their children.
+		vector<bool> reached(size, false);
+		vector<element_id> region;
+		for (const BulkEdge& edge : edges) {
+			if (!reached[edge.child]) {
+				reached[edge.child] = true;
+				region.push_back(edge.child);
+			}
+		}
+		for (size_t i = 0; i < region.size(); ++i) {
+			forEachChild(region[i], [&](element_id child, size_t) {
+				if (!reached[child]) {
+					reached[child] = true;
+					region.push_back(child);
+				}
+			});
+		}
+		vector<size_t> pendingParents(size, 0);
+		vector<element_id> order;
+		for (element_id e : region) {
+			forEachParent(e, [&](element_id parent, size_t) {
+				if (reached[parent]) {
+					++pendingParents[e];
+				}
+			});
+			if (pendingParents[e] == 0) {
+				order.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < order.size(); ++i) {
+			forEachChild(order[i], [&](element_id child, size_t) {
+				if (--pendingParents[child] == 0) {
+					order.push_back(child);
+				}
+			});
+		}
+
+		if (order.size() != region.size()) {
+			//Every element left unsorted has an unsorted parent, so walking
+			//up through them has to close a cycle.
+			vector<size_t> step(size, SIZE_MAX);
+			vector<element_id> path;
+			element_id e = noElement;
+			for (element_id candidate : region) {
+				if (pendingParents[candidate] != 0) {
+					e = candidate;
+					break;
+				}
+			}
+			vector<bool> onPath(size, false);
+			while (!onPath[e]) {
+				onPath[e] = true;
+				path.push_back(e);
+				element_id next = noElement;
+				forEachParent(e, [&](element_id parent, size_t edge) {
+					if (next == noElement && reached[parent] &&
+						pendingParents[parent] != 0) {
+						next = parent;
+						step[e] = edge;
+					}
+				});
+				e = next;
+			}
+			//The cycle is the part of the path from e on, walked upwards.
+			//Report its new relations in the downward order.
+			size_t first = std::find(path.begin(), path.end(), e) - path.begin();
+			cycle.clear();
+			for (size_t i = path.size(); i-- > first;) {
+				if (step[path[i]] != SIZE_MAX) {
+					cycle.push_back(edges[step[path[i]]].index);
+				}
+			}
+			added = 0;
+			return false;
+		}
+
+		vector<element_id> inserted(newValues.size());
+		for (size_t i = 0; i < newValues.size(); ++i) {
+			inserted[i] = insertElement(poset, newValues[i]);
+		}
+		auto actual = [&](element_id element) {
+			return element < base ? element : inserted[element - base];
+		};
+		for (const BulkEdge& edge : edges) {
+			linkChild(poset, actual(edge.parent), actual(edge.child));
+		}
+		if (poset.reductionEnabled && !edges.empty()) {
+			reducePoset(poset);
+		}
+		if (poset.closureEnabled && !edges.empty()) {
+			//Rebuilding costs less than updating it for every relation.
+			buildClosure(poset);
+		}
+		added = edges.size();
+		return true;
+	}
+
+	//Reads the whole file into memory. Returns false if it can't be read.
+	bool readFile(char const* path, vector<char>& data) {
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr) {
+			return false;
+		}
+		size_t constexpr chunk = 1 << 20;
+		size_t size = 0;
+		size_t read;
+		do {
+			data.resize(size + chunk);
+			read = fread(data.data() + size, 1, chunk, file);
+			size += read;
+		} while (read == chunk);
+		data.resize(size);
+		bool failed = ferror(file) != 0;
+		fclose(file);
+		return !failed;
+	}
+
+	//Continues the 64-bit FNV-1a hash of a poset file with the given bytes.
+	uint64_t checksumOf(uint64_t hash, const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3;
+		}
+		return hash;
+	}
+
+	uint64_t constexpr checksumStart = 0xcbf29ce484222325;
+
+	//Hash of the name in the index of a poset file.
+	uint64_t nameHash(string_view name) {
+		return checksumOf(checksumStart, name.data(), name.size());
+	}
+
+	//Indices of a single row of a poset file's adjacency.
+	struct IndexRange {
+		const uint32_t* first;
+		const uint32_t* last;
+
+		const uint32_t* begin() const {
+			return first;
+		}
+
+		const uint32_t* end() const {
+			return last;
+		}
+
+		size_t size() const {
+			return last - first;
+		}
+	};
+
+	//Adjacency stored in a poset file as compressed sparse rows.
+	struct FileAdjacency {
+		const uint64_t* offsets;
+		const uint32_t* indices;
+
+		IndexRange operator[](element_id element) const {
+			return IndexRange{ indices + offsets[element],
+				indices + offsets[element + 1] };
+		}
+	};
+
+	//Poset file read in place, either from memory or from mapped pages.
+	//The file must be checked by checkPosetFile first.
+	struct PosetFile {
+		explicit PosetFile(const char* data) : header(
+			*reinterpret_cast<const poset_file_header*>(data)),
+			names(section<uint64_t>(data, header.names_offset)),
+			index(section<uint64_t>(data, header.index_offset)),
+			strings(data + header.strings_offset),
+			children{ section<uint64_t>(data, header.children_offset),
+				section<uint32_t>(data, header.relations_offset) },
+			parents{ section<uint64_t>(data, header.parents_offset),
+				section<uint32_t>(data, header.parent_relations_offset) } {
+		}
+
+		size_t size() const {
+			return static_cast<size_t>(header.elements);
+		}
+
+		string_view name(element_id element) const {
+			return string_view(strings + names[element],
+				names[element + 1] - names[element] - 1);
+		}
+
+		const poset_file_header& header;
+		const uint64_t* names;
+		const uint64_t* index;
+		const char* strings;
+		FileAdjacency children;
+		FileAdjacency parents;
+
+	private:
+		template <typename T>
+		static const T* section(const char* data, uint64_t offset) {
+			return reinterpret_cast<const T*>(data + offset);
+		}
+	};
+
+	//Returns the index of the given value in the file, or noElement
+	//if the value isn't there.
+	element_id findElement(const PosetFile& file, string_view value) {
+		uint64_t hash = nameHash(value);
+		uint64_t mask = file.header.index_slots - 1;
+		for (uint64_t slot = hash & mask;; slot = (slot + 1) & mask) {
+			uint64_t entry = file.index[slot];
+			if (entry == POSET_FILE_EMPTY_SLOT) {
+				return noElement;
+			}
+			element_id element = static_cast<element_id>(entry);
+			if ((entry >> 32) == (hash >> 32) &&
+				file.name(element) == value) {
+				return element;
+			}
+		}
+	}
+
+	//Checks whether the value1 is the parent of the value2 in the file.
+	bool isBefore(const PosetFile& file, element_id value1,
+		element_id value2) {
+		return searchParent(file.size(), file.children, file.parents,
+			value1, value2);
+	}
+
+	//Compares the value1 with the value2 in the file.
+	cxx::poset_order compareElements(const PosetFile& file,
+		element_id value1, element_id value2) {
+		return searchOrder(file.size(), file.children, file.parents,
+			value1, value2);
+	}
+
+	//Like isBefore, but looks the answer up in the cache first, if
+	//the poset has one. Posets in the closure mode answer at once anyway.
+	bool isBefore(const Poset& poset, TestCache* cache, element_id value1,
+		element_id value2) {
+		if (cache == nullptr || poset.closureEnabled) {
+			return isBefore(poset, value1, value2);
+		}
+		SearchState& state = searchState();
+		bool answer;
+		if (cache->find(value1, value2, poset.generation, answer)) {
+			++state.cacheHits;
+			return answer;
+		}
+		++state.cacheMisses;
+		answer = isBefore(poset, value1, value2);
+		cache->store(value1, value2, poset.generation, answer);
+		return answer;
+	}
+
+	bool isBefore(const PosetFile& file, TestCache*, element_id value1,
+		element_id value2) {
+		return isBefore(file, value1, value2);
+	}
+
+	//Accessors shared by the regular posets and the files read in place.
+	size_t indexCount(const Poset& poset) {
+		return poset.names.size();
+	}
+
+	size_t indexCount(const PosetFile& file) {
+		return file.size();
+	}
+
+	string_view elementName(const Poset& poset, element_id element) {
+		return poset.names[element];
+	}
+
+	string_view elementName(const PosetFile& file, element_id element) {
+		return file.name(element);
+	}
+
+	bool isReduced(const Poset& poset) {
+		return poset.reductionEnabled;
+	}
+
+	bool isReduced(const PosetFile& file) {
+		return (file.header.flags & POSET_FILE_REDUCTION) != 0;
+	}
+
+	//Names of the elements to report, copied out of the poset, so that
+	//visitors run after its lock is released and may use the poset too.
+	class NameList {
+	public:
+		void reserve(size_t count) {
+			starts.reserve(count);
+		}
+
+		void add(string_view name) {
+			starts.push_back(chars.size());
+			chars.append(name.data(), name.size());
+			chars.push_back('\0');
+		}
+
+		//Passes the names to visit, until it returns false.
+		void visitAll(cxx::poset_visitor visit, void* context) const {
+			for (size_t i = 0; i < starts.size(); ++i) {
+				size_t end = i + 1 < starts.size() ? starts[i + 1] :
+					chars.size();
+				if (!visit(chars.data() + starts[i], end - starts[i] - 1,
+					context)) {
+					break;
+				}
+			}
+		}
+
+	private:
+		std::string chars;
+		vector<size_t> starts;
+	};
+
+	//Adds the element and all the elements after it to the names, reading
+	//them from the element's row of the closure. Returns false if
+	//the poset doesn't keep the closure.
+	bool enumerateRow(const Poset& poset, element_id element,
+		NameList& names) {
+		if (!poset.closureEnabled) {
+			return false;
+		}
+		const BitsetKernels& kernels = bitsetKernels();
+		const uint64_t* row = closureRow(poset, element);
+		size_t end = poset.closureWords * 64;
+		//The row tells the size of the upper set up front.
+		names.reserve(kernels.countBits(row, poset.closureWords) + 1);
+		names.add(poset.names[element]);
+		for (size_t e = kernels.findNext(row, poset.closureWords, 0); e < end;
+			e = kernels.findNext(row, poset.closureWords, e + 1)) {
+			names.add(poset.names[e]);
+		}
+		return true;
+	}
+
+	bool enumerateRow(const PosetFile&, element_id, NameList&) {
+		return false;
+	}
+
+	//Adds the names of the elements after the given one (or before it,
+	//if upward is false) to the names. If covers is set, adds only
+	//the elements right after (before) it, otherwise all of them,
+	//the element itself included. Walks the relation once.
+	template <typename P, typename Adjacency>
+	void enumerate(const P& poset, const Adjacency& adjacency,
+		element_id element, bool covers, NameList& names) {
+		auto report = [&](element_id e) {
+			names.add(elementName(poset, e));
+		};
+		if (covers && isReduced(poset)) {
+			//Every relation is a covering one.
+			for (element_id e : adjacency[element]) {
+				report(e);
+			}
+			return;
+		}
+
+		SearchState& state = searchState();
+		beginSearch(state, indexCount(poset));
+		uint32_t reached = state.epoch;
+		if (!covers) {
+			state.stamps[element] = reached;
+			report(element);
+			state.forward.push_back(element);
+			for (size_t i = 0; i < state.forward.size(); ++i) {
+				for (element_id e : adjacency[state.forward[i]]) {
+					if (state.stamps[e] != reached) {
+						state.stamps[e] = reached;
+						report(e);
+						state.forward.push_back(e);
+					}
+				}
+			}
+			return;
+		}
+
+		//Direct neighbours which can be reached through other ones
+		//aren't covers.
+		for (element_id e : adjacency[element]) {
+			state.forward.push_back(e);
+		}
+		for (size_t i = 0; i < state.forward.size(); ++i) {
+			for (element_id e : adjacency[state.forward[i]]) {
+				if (state.stamps[e] != reached) {
+					state.stamps[e] = reached;
+					state.forward.push_back(e);
+				}
+			}
+		}
+		for (element_id e : adjacency[element]) {
+			if (state.stamps[e] != reached) {
+				report(e);
+			}
+		}
+	}
+
+	//Compressed sparse rows of the given adjacency, with dense indices.
+	void appendRows(const Poset& poset, const RowArray& adjacency,
+		const vector<element_id>& dense, vector<uint64_t>& offsets,
+		vector<uint32_t>& indices) {
+		for (element_id e = 0; e < poset.names.size(); ++e) {
+			if (dense[e] != noElement) {
+				offsets.push_back(indices.size());
+				for (element_id e2 : adjacency[e]) {
+					indices.push_back(dense[e2]);
+				}
+			}
+		}
+		offsets.push_back(indices.size());
+	}
+
+	//Writes the poset to the file in the format of poset_file.h.
+	//Removed elements leave no gaps: the others are numbered anew,
+	//in the order of their current indices.
+	bool savePoset(const Poset& poset, FILE* file, bool checksum) {
+		size_t size = poset.names.size();
+		vector<element_id> dense(size, noElement);
+		element_id elements = 0;
+		for (element_id e = 0; e < size; ++e) {
+			if (poset.names[e].data() != nullptr) {
+				dense[e] = elements++;
+			}
+		}
+
+		vector<uint64_t> names;
+		vector<char> strings;
+		names.reserve(elements + 1);
+		uint64_t slots = 1;
+		while (slots <= uint64_t(elements) * 2) {
+			slots *= 2;
+		}
+		vector<uint64_t> index(slots, POSET_FILE_EMPTY_SLOT);
+		for (element_id e = 0; e < size; ++e) {
+			if (dense[e] != noElement) {
+				names.push_back(strings.size());
+				strings.insert(strings.end(), poset.names[e].begin(),
+					poset.names[e].end());
+				strings.push_back('\0');
+				uint64_t hash = nameHash(poset.names[e]);
+				uint64_t slot = hash & (slots - 1);
+				while (index[slot] != POSET_FILE_EMPTY_SLOT) {
+					slot = (slot + 1) & (slots - 1);
+				}
+				index[slot] = (hash >> 32 << 32) | dense[e];
+			}
+		}
+		names.push_back(strings.size());
+
+		vector<uint64_t> children;
+		vector<uint32_t> relations;
+		vector<uint64_t> parents;
+		vector<uint32_t> parentRelations;
+		children.reserve(elements + 1);
+		parents.reserve(elements + 1);
+		appendRows(poset, poset.children, dense, children, relations);
+		appendRows(poset, poset.parents, dense, parents, parentRelations);
+
+		poset_file_header header = {};
+		header.magic = POSET_FILE_MAGIC;
+		header.version = POSET_FILE_VERSION;
+		header.flags = (poset.closureEnabled ? POSET_FILE_CLOSURE : 0) |
+			(poset.reductionEnabled ? POSET_FILE_REDUCTION : 0) |
+			(checksum ? POSET_FILE_CHECKSUM : 0);
+		header.header_size = sizeof(header);
+		header.elements = elements;
+		header.relations = relations.size();
+		header.index_slots = slots;
+		header.strings_size = strings.size();
+
+		//Sections in the order they are written, 64-bit ones first,
+		//so each of them is aligned.
+		struct Section {
+			uint64_t& offset;
+			const void* data;
+			size_t size;
+		} sections[] = {
+			{ header.names_offset, names.data(),
+				names.size() * sizeof(uint64_t) },
+			{ header.children_offset, children.data(),
+				children.size() * sizeof(uint64_t) },
+			{ header.parents_offset, parents.data(),
+				parents.size() * sizeof(uint64_t) },
+			{ header.index_offset, index.data(),
+				index.size() * sizeof(uint64_t) },
+			{ header.relations_offset, relations.data(),
+				relations.size() * sizeof(uint32_t) },
+			{ header.parent_relations_offset, parentRelations.data(),
+				parentRelations.size() * sizeof(uint32_t) },
+			{ header.strings_offset, strings.data(), strings.size() }
+		};
+		uint64_t offset = sizeof(header);
+		uint64_t hash = checksumStart;
+		for (Section& section : sections) {
+			section.offset = offset;
+			offset += section.size;
+			if (checksum) {
+				hash = checksumOf(hash, section.data, section.size);
+			}
+		}
+		header.file_size = offset;
+		header.checksum = checksum ? hash : 0;
+
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+		for (const Section& section : sections) {
+			//Empty sections may have no data at all.
+			written = written && (section.size == 0 ||
+				fwrite(section.data, 1, section.size, file) == section.size);
+		}
+		return written;
+	}
+
+	//Checks whether the section of count values of type T lies inside
+	//the file and is aligned.
+	template <typename T>
+	bool checkSection(uint64_t offset, uint64_t count, size_t size) {
+		return offset % alignof(T) == 0 && offset <= size &&
+			count <= (size - offset) / sizeof(T);
+	}
+
+	//Checks the given compressed sparse rows.
+	bool checkRows(const FileAdjacency& adjacency, uint64_t elements,
+		uint64_t relations) {
+		if (adjacency.offsets[0] != 0 ||
+			adjacency.offsets[elements] != relations) {
+			return false;
+		}
+		for (uint64_t e = 0; e < elements; ++e) {
+			if (adjacency.offsets[e + 1] < adjacency.offsets[e] ||
+				adjacency.offsets[e + 1] > relations) {
+				return false;
+			}
+		}
+		for (uint64_t r = 0; r < relations; ++r) {
+			if (adjacency.indices[r] >= elements) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Checks whether the parents are the exact mirror of the children,
+	//with no relation listed twice, and whether the relation is acyclic.
+	//The rows must already be checked by checkRows.
+	bool checkRelations(const PosetFile& file, uint64_t elements,
+		uint64_t relations) {
+		//Children turned around: after[c] lists every e with c
+		//in children[e].
+		vector<uint64_t> afterStart(elements + 1, 0);
+		for (uint64_t r = 0; r < relations; ++r) {
+			++afterStart[file.children.indices[r] + 1];
+		}
+		for (uint64_t e = 0; e < elements; ++e) {
+			afterStart[e + 1] += afterStart[e];
+		}
+		vector<element_id> after(relations);
+		vector<uint64_t> filled(afterStart.begin(), afterStart.end() - 1);
+		for (element_id e = 0; e < elements; ++e) {
+			for (element_id child : file.children[e]) {
+				after[filled[child]++] = e;
+			}
+		}
+
+		//marks[e] is 2c + 1 once e is seen as a parent of c, and 2c + 2
+		//once the relation e->c is matched with a child.
+		vector<uint64_t> marks(elements, 0);
+		for (element_id c = 0; c < elements; ++c) {
+			IndexRange parents = file.parents[c];
+			if (parents.size() != afterStart[c + 1] - afterStart[c]) {
+				return false;
+			}
+			for (element_id parent : parents) {
+				if (marks[parent] == 2 * uint64_t(c) + 1) {
+					return false;
+				}
+				marks[parent] = 2 * uint64_t(c) + 1;
+			}
+			for (uint64_t i = afterStart[c]; i < afterStart[c + 1]; ++i) {
+				if (marks[after[i]] != 2 * uint64_t(c) + 1) {
+					return false;
+				}
+				marks[after[i]] = 2 * uint64_t(c) + 2;
+			}
+		}
+
+		//Kahn's algorithm sorts every element only if there's no cycle.
+		vector<uint64_t> pending(elements);
+		vector<element_id> order;
+		order.reserve(elements);
+		for (element_id e = 0; e < elements; ++e) {
+			pending[e] = file.parents[e].size();
+			if (pending[e] == 0) {
+				order.push_back(e);
+			}
+		}
+		for (size_t i = 0; i < order.size(); ++i) {
+			for (element_id child : file.children[order[i]]) {
+				if (--pending[child] == 0) {
+					order.push_back(child);
+				}
+			}
+		}
+		return order.size() == elements;
+	}
+
+	//Checks whether the given bytes are a well-formed poset file, so its
+	//sections can be read without any further bounds checks. Unless full
+	//is set, only the header is checked, in constant time, and the rest
+	//of the file must be trusted. The full check also makes sure that
+	//the relations form a partial order, as poset_save writes them.
+	bool checkPosetFile(const char* data, size_t size, bool full) {
+		const poset_file_header* header =
+			reinterpret_cast<const poset_file_header*>(data);
+		if (size < sizeof(poset_file_header) ||
+			header->magic != POSET_FILE_MAGIC ||
+			header->version != POSET_FILE_VERSION ||
+			header->header_size != sizeof(poset_file_header) ||
+			header->file_size != size ||
+			header->elements >= noElement) {
+			return false;
+		}
+
+		uint64_t elements = header->elements;
+		uint64_t slots = header->index_slots;
+		if (!checkSection<uint64_t>(header->names_offset, elements + 1, size) ||
+			!checkSection<uint64_t>(header->children_offset, elements + 1,
+				size) ||
+			!checkSection<uint64_t>(header->parents_offset, elements + 1,
+				size) ||
+			!checkSection<uint32_t>(header->relations_offset,
+				header->relations, size) ||
+			!checkSection<uint32_t>(header->parent_relations_offset,
+				header->relations, size) ||
+			!checkSection<uint64_t>(header->index_offset, slots, size) ||
+			!checkSection<char>(header->strings_offset, header->strings_size,
+				size) ||
+			slots <= elements || (slots & (slots - 1)) != 0) {
+			return false;
+		}
+		if (!full) {
+			return true;
+		}
+
+		if ((header->flags & POSET_FILE_CHECKSUM) &&
+			checksumOf(checksumStart, data + sizeof(poset_file_header),
+				size - sizeof(poset_file_header)) != header->checksum) {
+			return false;
+		}
+
+		PosetFile file(data);
+		if (file.names[0] != 0 || file.names[elements] != header->strings_size ||
+			!checkRows(file.children, elements, header->relations) ||
+			!checkRows(file.parents, elements, header->relations)) {
+			return false;
+		}
+		for (uint64_t e = 0; e < elements; ++e) {
+			//Every name is followed by '\0', so it's at least a byte long.
+			if (file.names[e + 1] <= file.names[e] ||
+				file.names[e + 1] > header->strings_size ||
+				file.strings[file.names[e + 1] - 1] != '\0') {
+				return false;
+			}
+		}
+		//Every element must be found under its own name, so the names
+		//are unique, and the index has an empty slot ending every probe.
+		uint64_t used = 0;
+		for (uint64_t slot = 0; slot < slots; ++slot) {
+			if (file.index[slot] != POSET_FILE_EMPTY_SLOT) {
+				if (static_cast<element_id>(file.index[slot]) >= elements) {
+					return false;
+				}
+				++used;
+			}
+		}
+		if (used != elements) {
+			return false;
+		}
+		for (element_id e = 0; e < elements; ++e) {
+			if (findElement(file, file.name(e)) != e) {
+				return false;
+			}
+		}
+		return checkRelations(file, elements, header->relations);
+	}
+
+	//Builds the poset directly from a checked file. Returns false
+	//if the file holds some name twice, which only a file trusted without
+	//the full check can do.
+	bool loadPoset(Poset& poset, const char* data) {
+		PosetFile file(data);
+		element_id elements = static_cast<element_id>(file.size());
+		poset.ids.reserve(elements);
+		poset.names.resize(elements);
+		poset.children.resize(elements);
+		poset.parents.resize(elements);
+		for (element_id e = 0; e < elements; ++e) {
+			string_view name = file.name(e);
+			if (findElement(poset, name) != noElement) {
+				return false;
+			}
+			poset.names.assign(e, name);
+			poset.ids.insert(name, e);
+			IndexRange children = file.children[e];
+			IndexRange parents = file.parents[e];
+			poset.children.edit(e).assign(children.begin(), children.end());
+			poset.parents.edit(e).assign(parents.begin(), parents.end());
+			if (parents.size() == 0) {
+				poset.minimal.insert(e);
+			}
+			if (children.size() == 0) {
+				poset.maximal.insert(e);
+			}
+		}
+
+		if (file.header.flags & POSET_FILE_CLOSURE) {
+			poset.closureEnabled = true;
+			buildClosure(poset);
+		}
+		poset.reductionEnabled = (file.header.flags & POSET_FILE_REDUCTION) != 0;
+		return true;
+	}
+
+	//Replaces the mapped file of the entry with the regular poset loaded
+	//from it, so the poset can be modified. Returns false if the trusted
+	//file turned out to be malformed, in which case the file stays mapped,
+	//so its data isn't lost. The caller must hold the entry's lock
+	//exclusively.
+	bool promoteMapped(PosetEntry& entry) {
+		const MappedFile* mapped = entry.mapped.load();
+		if (mapped == nullptr) {
+			return true;
+		}
+		if (!loadPoset(entry.poset, mapped->data())) {
+			entry.poset = Poset();
+			if constexpr (debug) {
+				cerr << "poset " << entry.id << ": mapped file is malformed,"
+					<< " so it's only read in place" << "\n";
+			}
+			return false;
+		}
+		entry.mapped.store(nullptr, std::memory_order_release);
+		retire([mapped]() { delete mapped; });
+		return true;
+	}
+
+	//Value as printed in the debug messages. Formatted only when it's
+	//actually printed, so it costs nothing in the release builds.
+	struct Quoted {
+		char const* value;
+		size_t length;
+	};
+
+	std::ostream& operator<<(std::ostream& os, Quoted quoted) {
+		if (quoted.value == nullptr) {
+			return os << "NULL";
+		}
+		os << "\"";
+		os.write(quoted.value, quoted.length);
+		return os << "\"";
+	}
+
+	//Function checks, if the given string is NULL
+	Quoted ifNULL(char const* value, size_t length) {
+		return Quoted{ value, length };
+	}
+
+	//Length of the given null-terminated value, or 0 for NULL.
+	size_t valueLength(char const* value) {
+		return value == nullptr ? 0 : strlen(value);
+	}
+}
+
+namespace {
+	bool posetRemove(char const* name, unsigned long id, char const* value,
+		size_t length) {
+		Quoted s = ifNULL(value, length);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s << ")" << "\n";
+		}
+
+		if (value == NULL) {
+			//We can't remove NULL;
+			if constexpr (debug) {
+				cerr << name << ": invalid value (NULL)" << "\n";
+			}
+
+			return false;
+		}
+
+		string_view view(value, length);
+		WriteHandle poset(id);
+		element_id element = noElement;
+		if (!poset) {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": " << "poset " << id
+					<< " does not exist" << "\n";
+			}
+
+			return false;
+		}
+		else if ((element = findElement(*poset, view)) != noElement) {
+			//Poset exists and is not empty and the value is in poset.
+			noteElements(element, noElement);
+			if (poset->reductionEnabled) {
+				//Relations through the element are re-mapped only where
+				//no other path keeps them, which can be checked only
+				//once it's gone.
+				vector<element_id> parents(poset->parents[element].begin(),
+					poset->parents[element].end());
+				vector<element_id> children(poset->children[element].begin(),
+					poset->children[element].end());
+				eraseElement(*poset, element);
+				for (element_id parent : parents) {
+					for (element_id child : children) {
+						relinkChild(*poset, parent, child);
+					}
+				}
+			}
+			else {
+				for (element_id parent : poset->parents[element]) {
+					//Value is the child of something,
+					//we need to re-map the relation.
+					for (element_id child : poset->children[element]) {
+						insertChild(*poset, parent, child);
+					}
+				}
+				//Remove element and its relations from the poset.
+				eraseElement(*poset, element);
+			}
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element " << s
+					<< " removed" << "\n";
+			}
+			return true;
+		}
+		else {
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element " << s
+					<< " does not exist" << "\n";
+			}
+
+			return false;
+		}
+	}
+
+	bool posetDel(char const* name, unsigned long id, char const* value1,
+		size_t length1, char const* value2, size_t length2) {
+		Quoted s1 = ifNULL(value1, length1);
+		Quoted s2 = ifNULL(value2, length2);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s1 << ", " << s2 << ")" << "\n";
+		}
+
+		if (value1 == NULL || value2 == NULL) {
+			//We can't delete relation between NULLs.
+			if constexpr (debug) {
+				if (value1 == NULL) {
+					cerr << name << ": invalid value1 (NULL)" << "\n";
+				}
+
+				if (value2 == NULL) {
+					cerr << name << ": invalid value2 (NULL)" << "\n";
+				}
+			}
+
+			return false;
+		}
+
+		string_view view1(value1, length1);
+		string_view view2(value2, length2);
+		WriteHandle poset(id);
+		element_id element1 = noElement;
+		element_id element2 = noElement;
+		if (!poset) {//Poset doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id
+					<< " does not exist" << "\n";
+			}
+			return false;
+		}
+		else if ((element1 = findElement(*poset, view1)) == noElement) {
+			//Value1 doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element " << s1
+					<< " does not exist" << "\n";
+			}
+			return false;
+		}
+		else if ((element2 = findElement(*poset, view2)) == noElement) {
+			//Value2 doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element " << s2
+					<< " does not exist" << "\n";
+			}
+			return false;
+		}
+
+		//Both values exist in the given poset.
+		noteElements(element1, element2);
+		if (element1 == element2) {
+			//We can't delete a->a relation.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", relation ("
+					<< s1 << ", " << s2 << ") cannot be deleted" << "\n";
+			}
+			return false;
+		}
+
+		if (findChild(*poset, element1, element2)) {
+			//Value1 and Value2 are in a relation. In the reduction mode
+			//every relation is a covering one, so it can always be deleted.
+			if (!poset->reductionEnabled) {
+				for (element_id elem : poset->children[element1]) {
+					if (elem != element2) {
+						//Value2 isn't strictly after ther
+						//value1 in the relation chain.
+						if (isBefore(*poset, elem, element2)) {
+							//If we have following relations: b->c, c->d,
+							//b->d, then we can't delete the relation.
+							if constexpr (debug) {
+								cerr << name << ": poset " << id
+									<< ", relation (" << s1 << ", " << s2
+									<< ") cannot be deleted" << "\n";
+							}
+							return false;
+						}
+					}
+				}
+			}
+			eraseChild(*poset, element1, element2);
+			for (element_id parent : poset->parents[element1]) {
+				//a->b->c, deleting b->c, we need to remap it so that a->c.
+				relinkChild(*poset, parent, element2);
+			}
+			//a->b->c, deleting a->b, we need to remap it so that a->c
+			for (element_id elem : poset->children[element2]) {
+				relinkChild(*poset, element1, elem);
+			}
+			if (poset->closureEnabled) {
+				//Every other pair stays in the relation thanks to the remapping.
+				clearClosureBit(editClosureRow(*poset, element1), element2);
+			}
+
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", relation (" <<
+					s1 << ", " << s2 << ") deleted" << "\n";
+			}
+
+			return true;
+		}
+		else {
+			//Elements aren't in a relation, we delete nothing.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", relation ("
+					<< s1 << ", " << s2 << ") cannot be deleted" << "\n";
+			}
+			return false;
+		}
+	}
+
+	bool posetInsert(char const* name, unsigned long id, char const* value,
+		size_t length) {
+		Quoted s = ifNULL(value, length);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s << ")" << "\n";
+		}
+
+		if (value == NULL) {
+			//We can't add null value;
+			if constexpr (debug) {
+				cerr << name << ": invalid value (NULL)" << "\n";
+			}
+			return false;
+		}
+
+		string_view view(value, length);
+		WriteHandle poset(id);
+		if (poset) {
+			//We found the given poset, we can try to insert a new
+			//element into it.
+			if (findElement(*poset, view) == noElement) {
+				//Current poset doesn't contain the value, so we can 
+				//insert it into poset.
+				noteElements(insertElement(*poset, view), noElement);
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", element "
+						<< s << " inserted" << "\n";
+				}
+				return true;
+			}
+			else {//Poset already contains the value, we add nothing.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", element "
+						<< s << " already exists" << "\n";
+				}
+				return false;
+			}
+		}
+		else {//We inserted nothing, because the given poset doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id <<
+					" does not exist" << "\n";
+			}
+			return false;
+		}
+	}
+
+	bool posetAdd(char const* name, unsigned long id, char const* value1,
+		size_t length1, char const* value2, size_t length2) {
+		Quoted s1 = ifNULL(value1, length1);
+		Quoted s2 = ifNULL(value2, length2);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s1 << ", "
+				<< s2 << ")" << "\n";
+		}
+
+		if (value1 == NULL || value2 == NULL) {
+			//We can't delete relation between NULLs.
+			if constexpr (debug) {
+				if (value1 == NULL) {
+					cerr << name << ": invalid value1 (NULL)" << "\n";
+				}
+
+				if (value2 == NULL) {
+					cerr << name << ": invalid value2 (NULL)" << "\n";
+				}
+			}
+
+			return false;
+		}
+
+		string_view view1(value1, length1);
+		string_view view2(value2, length2);
+		WriteHandle poset(id);
+		if (poset) {
+			//Poset with the given id exists.
+			element_id element1 = findElement(*poset, view1);
+			element_id element2 = findElement(*poset, view2);
+			noteElements(element1, element2);
+			if (element1 == noElement) {
+				//Value1 is not in the poset.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", element " << s1
+						<< " does not exist" << "\n";
+				}
+				return false;
+			}
+			else if (element2 == noElement) {
+				//Value2 is not in the poset.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", element " << s2
+						<< " does not exist" << "\n";
+				}
+				return false;
+			}
+			else {
+				//Both values are in the poset.
+				if (element1 == element2) {
+					//We are trying to add a relation betweene the same element,
+					//and that relation already exists.
+					if constexpr (debug) {
+						cerr << name << ": poset " << id << ", relation (" << s1
+							<< ", " << s2 << ") cannot be added" << "\n";
+					}
+					return false;
+				}
+				else if (compareElements(*poset, element1, element2) !=
+					cxx::POSET_INCOMPARABLE) {
+					//if value2 is already a parent of the value 1, or value1
+					//is a parent of the value2, we don't want 
+					//to add a new relation.
+					if constexpr (debug) {
+						cerr << name << ": poset " << id << ", relation (" << s1
+							<< ", " << s2 << ") cannot be added" << "\n";
+					}
+					return false;
+				}
+				else {//Adds value2 to the children of the value1.
+					insertRelation(*poset, element1, element2);
+					if constexpr (debug) {
+						cerr << name << ": poset " << id << ", relation (" << s1
+							<< ", " << s2 << ") added" << "\n";
+					}
+					return true;
+				}
+			}
+		}
+		else {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << " does not exist" << "\n";
+			}
+			return false;
+		}
+	}
+
+	//Checks the relation between both values in the given poset, which
+	//is either a regular one or a file read in place.
+	template <typename P>
+	bool testRelation(char const* name, unsigned long id, const P& poset,
+		TestCache* cache, string_view view1, string_view view2, Quoted s1,
+		Quoted s2) {
+		element_id element1 = findElement(poset, view1);
+		noteElements(element1, noElement);
+		if (view1 == view2) {
+			//value1 is equal to value2.
+			if (element1 != noElement) {
+				//value1 exists and is in relation with itself.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", relation ("
+						<< s1 << ", " << s1 << ")" << " exists" << "\n";
+				}
+				return true;
+			}
+			else {
+				//value1 is not in the given poset.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", element "
+						<< s2 << " does not exist" << "\n";
+				}
+				return false;
+			}
+		}
+
+		element_id element2 = noElement;
+		if (element1 == noElement) {
+			//Value1 is not in the given poset.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element "
+					<< s1 << " does not exist" << "\n";
+			}
+			return false;
+		}
+		else if ((element2 = findElement(poset, view2)) == noElement) {
+			//Value2 is not in the given poset.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element "
+					<< s2 << " does not exist" << "\n";
+			}
+			return false;
+		}
+		else {
+			//Both values are in the poset.
+			noteElements(element1, element2);
+			if (isBefore(poset, cache, element1, element2)) {
+				//Value1 is a parent of the value2.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", relation ("
+						<< s1 << ", " << s2 << ")" << " exists" << "\n";
+				}
+				return true;
+			}
+			else {//Value1 is not a parent of the value2.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << ", relation ("
+						<< s1 << ", " << s2 << ")" <<
+						" does not exist" << "\n";
+				}
+				return false;
+			}
+		}
+	}
+
+	bool posetTest(char const* name, unsigned long id, char const* value1,
+		size_t length1, char const* value2, size_t length2) {
+		Quoted s1 = ifNULL(value1, length1);
+		Quoted s2 = ifNULL(value2, length2);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s1 << ", " << s2
+				<< ")" << "\n";
+		}
+
+		if (value1 == NULL || value2 == NULL) {
+			//We can't delete relation between NULLs.
+			if constexpr (debug) {
+				if (value1 == NULL) {
+					cerr << name << ": invalid value1 (NULL)" << "\n";
+				}
+
+				if (value2 == NULL) {
+					cerr << name << ": invalid value2 (NULL)" << "\n";
+				}
+			}
+
+			return false;
+		}
+
+		string_view view1(value1, length1);
+		string_view view2(value2, length2);
+		ReadHandle poset(id, true);
+		if (const MappedFile* file = poset.mappedFile()) {
+			//Poset with the given id exists, and is read in place.
+			return testRelation(name, id, PosetFile(file->data()), nullptr,
+				view1, view2, s1, s2);
+		}
+		else if (poset) {
+			//Poset with the given id exists.
+			return testRelation(name, id, *poset, poset.testCache(), view1,
+				view2, s1, s2);
+		}
+		else {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << " does not exist" << "\n";
+			}
+			return false;
+		}
+	}
+
+	//Name of the order, for the debug messages.
+	char const* orderName(cxx::poset_order order) {
+		switch (order) {
+		case cxx::POSET_LESS:
+			return "less";
+		case cxx::POSET_GREATER:
+			return "greater";
+		case cxx::POSET_EQUAL:
+			return "equal";
+		default:
+			return "incomparable";
+		}
+	}
+
+	//Compares both values in the given poset, which is either a regular
+	//one or a file read in place.
+	template <typename P>
+	bool compareRelation(char const* name, unsigned long id, const P& poset,
+		string_view view1, string_view view2, Quoted s1, Quoted s2,
+		cxx::poset_order* order) {
+		element_id element1 = findElement(poset, view1);
+		element_id element2 = findElement(poset, view2);
+		noteElements(element1, element2);
+		if (element1 == noElement) {
+			//Value1 is not in the given poset.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element "
+					<< s1 << " does not exist" << "\n";
+			}
+			return false;
+		}
+		else if (element2 == noElement) {
+			//Value2 is not in the given poset.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", element "
+					<< s2 << " does not exist" << "\n";
+			}
+			return false;
+		}
+		else {
+			//Both values are in the poset.
+			*order = compareElements(poset, element1, element2);
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", " << s1 << " is "
+					<< orderName(*order) << " to " << s2 << "\n";
+			}
+			return true;
+		}
+	}
+
+	bool posetCompare(char const* name, unsigned long id, char const* value1,
+		size_t length1, char const* value2, size_t length2,
+		cxx::poset_order* order) {
+		Quoted s1 = ifNULL(value1, length1);
+		Quoted s2 = ifNULL(value2, length2);
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s1 << ", " << s2
+				<< ")" << "\n";
+		}
+
+		if (value1 == NULL || value2 == NULL || order == NULL) {
+			//We can't compare NULLs.
+			if constexpr (debug) {
+				if (value1 == NULL) {
+					cerr << name << ": invalid value1 (NULL)" << "\n";
+				}
+
+				if (value2 == NULL) {
+					cerr << name << ": invalid value2 (NULL)" << "\n";
+				}
+
+				if (order == NULL) {
+					cerr << name << ": invalid order (NULL)" << "\n";
+				}
+			}
+
+			return false;
+		}
+
+		string_view view1(value1, length1);
+		string_view view2(value2, length2);
+		ReadHandle poset(id, true);
+		if (const MappedFile* file = poset.mappedFile()) {
+			//Poset with the given id exists, and is read in place.
+			return compareRelation(name, id, PosetFile(file->data()), view1,
+				view2, s1, s2, order);
+		}
+		else if (poset) {
+			//Poset with the given id exists.
+			return compareRelation(name, id, *poset, view1, view2, s1, s2,
+				order);
+		}
+		else {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << " does not exist" << "\n";
+			}
+			return false;
+		}
+	}
+}
+
+unsigned long cxx::poset_new(void) {
+	CallRecorder call(POSET_OP_NEW);
+	if constexpr (debug) {
+		cerr << "poset_new()" << "\n";
+	}
+
+	auto entry = std::make_unique<PosetEntry>();
+	callContext().entry = entry.get();
+	unsigned long id = registerPoset(std::move(entry));
+	callContext().id = id;
+
+	if constexpr (debug) {
+		cerr << "poset_new: poset " << id << " created" << "\n";
+	}
+
+	return id;
+}
+
+size_t cxx::poset_size(unsigned long id) {
+	CallRecorder call(POSET_OP_SIZE);
+	if constexpr (debug) {
+		cerr << "poset_size(" << id << ")" << "\n";
+	}
+
+	ReadHandle poset(id, true);
+	if (poset) {
+		const MappedFile* file = poset.mappedFile();
+		size_t size = file != nullptr ? PosetFile(file->data()).size() :
+			poset->ids.size();
+		if constexpr (debug) {
+			cerr << "poset_size: poset " << id
+				<< " contains " << size
+				<< " element(s)" << "\n";
+		}
+		return size;
+	}
+	else {
+		if constexpr (debug) {
+			cerr << "poset_size: poset " << id
+				<< " does not exist" << "\n";
+		}
+
+		return 0;
+	}
+}
+
+void cxx::poset_delete(unsigned long id) {
+	CallRecorder call(POSET_OP_DELETE);
+	callContext().id = id;
+	if constexpr (debug) {
+		cerr << "poset_delete(" << id << ")" << "\n";
+	}
+
+	PosetEntry* entry = unregisterPoset(id);
+	if (entry != nullptr) {
+		//We found the given poset in the poset_collection. Operations
+		//which already hold it will finish before it's freed.
+		callContext().entry = entry;
+		retire([entry]() { delete entry; });
+		if constexpr (debug) {
+			cerr << "poset_delete: poset " << id << " deleted" << "\n";
+		}
+	}
+	else if constexpr (debug) {
+		//If poset isn't in poset_collection, it means that it doesn't exist.
+		cerr << "poset_delete: poset " << id << " does not exist" << "\n";
+	}
+}
+
+bool cxx::poset_remove(unsigned long id, char const* value) {
+	CallRecorder call(POSET_OP_REMOVE);
+	return call.finish(posetRemove("poset_remove", id, value,
+		valueLength(value)));
+}
+
+bool cxx::poset_remove_n(unsigned long id, char const* value,
+	size_t length) {
+	CallRecorder call(POSET_OP_REMOVE);
+	return call.finish(posetRemove("poset_remove_n", id, value, length));
+}
+
+bool cxx::poset_del(unsigned long id, char const* value1,
+	char const* value2) {
+	CallRecorder call(POSET_OP_DEL);
+	return call.finish(posetDel("poset_del", id, value1,
+		valueLength(value1), value2, valueLength(value2)));
+}
+
+bool cxx::poset_del_n(unsigned long id, char const* value1,
+	size_t length1, char const* value2, size_t length2) {
+	CallRecorder call(POSET_OP_DEL);
+	return call.finish(posetDel("poset_del_n", id, value1, length1,
+		value2, length2));
+}
+
+bool cxx::poset_insert(unsigned long id, char const* value) {
+	CallRecorder call(POSET_OP_INSERT);
+	return call.finish(posetInsert("poset_insert", id, value,
+		valueLength(value)));
+}
+
+bool cxx::poset_insert_n(unsigned long id, char const* value,
+	size_t length) {
+	CallRecorder call(POSET_OP_INSERT);
+	return call.finish(posetInsert("poset_insert_n", id, value, length));
+}
+
+bool cxx::poset_add(unsigned long id, char const* value1,
+	char const* value2) {
+	CallRecorder call(POSET_OP_ADD);
+	return call.finish(posetAdd("poset_add", id, value1,
+		valueLength(value1), value2, valueLength(value2)));
+}
+
+bool cxx::poset_add_n(unsigned long id, char const* value1,
+	size_t length1, char const* value2, size_t length2) {
+	CallRecorder call(POSET_OP_ADD);
+	return call.finish(posetAdd("poset_add_n", id, value1, length1,
+		value2, length2));
+}
+
+bool cxx::poset_test(unsigned long id, char const* value1,
+	char const* value2) {
+	CallRecorder call(POSET_OP_TEST);
+	return call.finish(posetTest("poset_test", id, value1,
+		valueLength(value1), value2, valueLength(value2)));
+}
+
+bool cxx::poset_test_n(unsigned long id, char const* value1,
+	size_t length1, char const* value2, size_t length2) {
+	CallRecorder call(POSET_OP_TEST);
+	return call.finish(posetTest("poset_test_n", id, value1, length1,
+		value2, length2));
+}
+
+bool cxx::poset_compare(unsigned long id, char const* value1,
+	char const* value2, poset_order* order) {
+	CallRecorder call(POSET_OP_COMPARE);
+	return call.finish(posetCompare("poset_compare", id, value1,
+		valueLength(value1), value2, valueLength(value2), order));
+}
+
+bool cxx::poset_compare_n(unsigned long id, char const* value1,
+	size_t length1, char const* value2, size_t length2, poset_order* order) {
+	CallRecorder call(POSET_OP_COMPARE);
+	return call.finish(posetCompare("poset_compare_n", id, value1, length1,
+		value2, length2, order));
+}
+
+void cxx::poset_clear(unsigned long id) {
+	CallRecorder call(POSET_OP_CLEAR);
+	if constexpr (debug) {
+		cerr << "poset_clear(" << id << ")" << "\n";
+	}
+
+	WriteHandle poset(id);
+	if (poset) {
+		//Poset with the given id exists. Its chunks are freed at once,
+		//or left to the copies sharing them.
+		bool closureEnabled = poset->closureEnabled;
+		bool reductionEnabled = poset->reductionEnabled;
+		uint64_t generation = poset->generation;
+		*poset = Poset();
+		poset->closureEnabled = closureEnabled;
+		poset->reductionEnabled = reductionEnabled;
+		poset->generation = generation + 1;
+		if constexpr (debug) {
+			cerr << "poset_clear: poset " << id << " cleared" << "\n";
+		}
+	}
+	else if constexpr (debug) {//Poset with the given id doesn't exists.
+		cerr << "poset_clear: poset " << id << " does not exist" << "\n";
+	}
+}
+
+bool cxx::poset_set_closure(unsigned long id, bool enabled) {
+	if constexpr (debug) {
+		cerr << "poset_set_closure(" << id << ", "
+			<< (enabled ? "true" : "false") << ")" << "\n";
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		if constexpr (debug) {
+			cerr << "poset_set_closure: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return false;
+	}
+
+	if (enabled && !poset->closureEnabled) {
+		poset->closureEnabled = true;
+		buildClosure(*poset);
+	}
+	else if (!enabled && poset->closureEnabled) {
+		//Release the matrix, it can be built again later.
+		poset->closureEnabled = false;
+		poset->closureWords = 0;
+		poset->closure.clear();
+	}
+
+	if constexpr (debug) {
+		cerr << "poset_set_closure: poset " << id << ", closure "
+			<< (enabled ? "enabled" : "disabled") << "\n";
+	}
+	return true;
+}
+
+bool cxx::poset_build_closure(unsigned long id, size_t threads) {
+	if constexpr (debug) {
+		cerr << "poset_build_closure(" << id << ", " << threads << ")"
+			<< "\n";
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		if constexpr (debug) {
+			cerr << "poset_build_closure: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return false;
+	}
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	if (!poset->closureEnabled) {
+		poset->closureEnabled = true;
+		buildClosure(*poset, threads);
+	}
+
+	if constexpr (debug) {
+		cerr << "poset_build_closure: poset " << id << ", closure built"
+			<< "\n";
+	}
+	return true;
+}
+
+bool cxx::poset_set_reduction(unsigned long id, bool enabled) {
+	if constexpr (debug) {
+		cerr << "poset_set_reduction(" << id << ", "
+			<< (enabled ? "true" : "false") << ")" << "\n";
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		if constexpr (debug) {
+			cerr << "poset_set_reduction: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return false;
+	}
+
+	if (enabled && !poset->reductionEnabled) {
+		//From now on, every modification keeps the poset reduced.
+		reducePoset(*poset);
+	}
+	poset->reductionEnabled = enabled;
+
+	if constexpr (debug) {
+		cerr << "poset_set_reduction: poset " << id << ", reduction "
+			<< (enabled ? "enabled" : "disabled") << "\n";
+	}
+	return true;
+}
+
+bool cxx::poset_compact(unsigned long id) {
+	if constexpr (debug) {
+		cerr << "poset_compact(" << id << ")" << "\n";
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		if constexpr (debug) {
+			cerr << "poset_compact: poset " << id << " does not exist" << "\n";
+		}
+		return false;
+	}
+
+	size_t removed = reducePoset(*poset);
+
+	if constexpr (debug) {
+		cerr << "poset_compact: poset " << id << ", " << removed
+			<< " redundant relation(s) deleted" << "\n";
+	}
+	return true;
+}
+
+size_t cxx::poset_insert_many(unsigned long id, size_t count,
+	char const* const* values, bool* results) {
+	CallRecorder call(POSET_OP_INSERT);
+	if constexpr (debug) {
+		cerr << "poset_insert_many(" << id << ", " << count << ")" << "\n";
+	}
+
+	if (values == NULL || results == NULL) {
+		//We can't read values or write results.
+		if constexpr (debug) {
+			cerr << "poset_insert_many: invalid array (NULL)" << "\n";
+		}
+		return call.finishBatch(count, 0);
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		std::fill_n(results, count, false);
+		if constexpr (debug) {
+			cerr << "poset_insert_many: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return call.finishBatch(count, 0);
+	}
+
+	size_t inserted = 0;
+	for (size_t i = 0; i < count; ++i) {
+		results[i] = values[i] != NULL &&
+			findElement(*poset, values[i]) == noElement;
+		if (results[i]) {
+			insertElement(*poset, values[i]);
+			++inserted;
+		}
+	}
+
+	if constexpr (debug) {
+		cerr << "poset_insert_many: poset " << id << ", " << inserted
+			<< " of " << count << " element(s) inserted" << "\n";
+	}
+	return call.finishBatch(count, inserted);
+}
+
+size_t cxx::poset_add_many(unsigned long id, size_t count,
+	char const* const* values1, char const* const* values2, bool* results) {
+	CallRecorder call(POSET_OP_ADD);
+	if constexpr (debug) {
+		cerr << "poset_add_many(" << id << ", " << count << ")" << "\n";
+	}
+
+	if (values1 == NULL || values2 == NULL || results == NULL) {
+		//We can't read values or write results.
+		if constexpr (debug) {
+			cerr << "poset_add_many: invalid array (NULL)" << "\n";
+		}
+		return call.finishBatch(count, 0);
+	}
+
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		std::fill_n(results, count, false);
+		if constexpr (debug) {
+			cerr << "poset_add_many: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return call.finishBatch(count, 0);
+	}
+
+	//Resolve all values once.
+	vector<element_id> elements1(count, noElement);
+	vector<element_id> elements2(count, noElement);
+	for (size_t i = 0; i < count; ++i) {
+		if (values1[i] != NULL && values2[i] != NULL) {
+			elements1[i] = findElement(*poset, values1[i]);
+			elements2[i] = findElement(*poset, values2[i]);
+		}
+	}
+
+	size_t added = 0;
+	bool validated = false;
+	if (!poset->closureEnabled && !poset->reductionEnabled) {
+		//Links every relation which isn't implied yet, and then checks
+		//them for cycles all at once, instead of searching for the reverse
+		//path separately for each of them.
+		vector<element_id> sources;
+		for (size_t i = 0; i < count; ++i) {
+			element_id element1 = elements1[i];
+			element_id element2 = elements2[i];
+			results[i] = element1 != noElement && element2 != noElement &&
+				element1 != element2 && !isBefore(*poset, element1, element2);
+			if (results[i]) {
+				linkChild(*poset, element1, element2);
+				sources.push_back(element2);
+				++added;
+			}
+		}
+		validated = sources.empty() || !findCycle(*poset, sources);
+		if (!validated) {
+			//Some relations contradict each other or the poset. Roll back
+			//and add them one by one, so the results are the same as for
+			//consecutive poset_add calls.
+			for (size_t i = count; i-- > 0;) {
+				if (results[i]) {
+					eraseChild(*poset, elements1[i], elements2[i]);
+				}
+			}
+			added = 0;
+		}
+	}
+
+	if (!validated) {
+		for (size_t i = 0; i < count; ++i) {
+			results[i] = elements1[i] != noElement &&
+				elements2[i] != noElement &&
+				tryInsertRelation(*poset, elements1[i], elements2[i]);
+			if (results[i]) {
+				++added;
+			}
+		}
+	}
+
+	if constexpr (debug) {
+		cerr << "poset_add_many: poset " << id << ", " << added
+			<< " of " << count << " relation(s) added" << "\n";
+	}
+	return call.finishBatch(count, added);
+}
+
+namespace {
+	//Stores the cycle's relations, as numbered by the given function,
+	//in the caller's buffer of *length entries, and sets *length
+	//to the length of the whole cycle.
+	template <typename F>
+	void reportCycle(const vector<size_t>& cycle, size_t* buffer,
+		size_t* length, F&& number) {
+		if (length == NULL) {
+			return;
+		}
+		if (buffer != NULL) {
+			for (size_t i = 0; i < std::min(*length, cycle.size()); ++i) {
+				buffer[i] = number(cycle[i]);
+			}
+		}
+		*length = cycle.size();
+	}
+
+	bool posetAddEdges(char const* name, unsigned long id, size_t count,
+		char const* const* values1, char const* const* values2,
+		size_t& added, vector<size_t>& cycle) {
+		WriteHandle poset(id);
+		if (!poset) {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << " does not exist" << "\n";
+			}
+			return false;
+		}
+
+		if (!addEdges(*poset, count, values1, values2, added, cycle)) {
+			//Nothing was added.
+			if constexpr (debug) {
+				cerr << name << ": poset " << id << ", relations form a cycle"
+					<< " through " << cycle.size() << " of them" << "\n";
+			}
+			return false;
+		}
+
+		if constexpr (debug) {
+			cerr << name << ": poset " << id << ", " << added << " of "
+				<< count << " relation(s) added" << "\n";
+		}
+		return true;
+	}
+}
+
+bool cxx::poset_add_edges(unsigned long id, size_t count,
+	char const* const* values1, char const* const* values2, size_t* cycle,
+	size_t* cycle_length) {
+	CallRecorder call(POSET_OP_ADD);
+	if constexpr (debug) {
+		cerr << "poset_add_edges(" << id << ", " << count << ")" << "\n";
+	}
+
+	bool valid = count == 0 || (values1 != NULL && values2 != NULL);
+	for (size_t i = 0; valid && i < count; ++i) {
+		valid = values1[i] != NULL && values2[i] != NULL;
+	}
+
+	vector<size_t> found;
+	size_t added = 0;
+	bool success = false;
+	if (!valid) {
+		//The batch can't be added as a whole.
+		if constexpr (debug) {
+			cerr << "poset_add_edges: invalid value (NULL)" << "\n";
+		}
+	}
+	else {
+		success = posetAddEdges("poset_add_edges", id, count, values1,
+			values2, added, found);
+	}
+	reportCycle(found, cycle, cycle_length,
+		[](size_t index) { return index; });
+	call.finishBatch(count, added);
+	return success;
+}
+
+bool cxx::poset_add_edges_file(unsigned long id, char const* path,
+	size_t* cycle, size_t* cycle_length) {
+	CallRecorder call(POSET_OP_ADD);
+	if constexpr (debug) {
+		cerr << "poset_add_edges_file(" << id << ", "
+			<< ifNULL(path, valueLength(path)) << ")" << "\n";
+	}
+
+	vector<char> data;
+	vector<char const*> values1;
+	vector<char const*> values2;
+	vector<size_t> lines;
+	bool valid = path != NULL && readFile(path, data);
+	//Values are cut out of the file in place, so the last one needs
+	//its terminator too.
+	data.push_back('\n');
+	size_t lineStart = 0;
+	for (size_t i = 0; valid && i < data.size(); ++i) {
+		if (data[i] != '\n') {
+			continue;
+		}
+		size_t lineEnd = i;
+		if (lineEnd > lineStart && data[lineEnd - 1] == '\r') {
+			--lineEnd;
+		}
+		if (lineEnd > lineStart) {
+			char* separator = static_cast<char*>(memchr(data.data() + lineStart,
+				'\t', lineEnd - lineStart));
+			if (separator == nullptr) {
+				valid = false;
+				if constexpr (debug) {
+					cerr << "poset_add_edges_file: line " << lines.size() + 1
+						<< " has no tab" << "\n";
+				}
+			}
+			else {
+				*separator = '\0';
+				data[lineEnd] = '\0';
+				values1.push_back(data.data() + lineStart);
+				values2.push_back(separator + 1);
+			}
+		}
+		lines.push_back(values1.size());
+		lineStart = i + 1;
+	}
+
+	vector<size_t> found;
+	size_t added = 0;
+	bool success = false;
+	if (path == NULL || !valid) {
+		if constexpr (debug) {
+			cerr << "poset_add_edges_file: cannot read "
+				<< ifNULL(path, valueLength(path)) << "\n";
+		}
+	}
+	else {
+		success = posetAddEdges("poset_add_edges_file", id, values1.size(),
+			values1.data(), values2.data(), added, found);
+	}
+	//Relations are reported by the numbers of their lines.
+	reportCycle(found, cycle, cycle_length, [&](size_t index) {
+		return static_cast<size_t>(std::upper_bound(lines.begin(),
+			lines.end(), index) - lines.begin()) + 1;
+	});
+	call.finishBatch(values1.size(), added);
+	return success;
+}
+
+namespace {
+	bool posetEnumerate(char const* name, unsigned long id, char const* value,
+		bool upward, bool covers, cxx::poset_visitor visit, void* context) {
+		Quoted s = ifNULL(value, valueLength(value));
+
+		if constexpr (debug) {
+			cerr << name << "(" << id << ", " << s << ")" << "\n";
+		}
+
+		if (value == NULL || visit == NULL) {
+			//We can't look NULL up or report anything.
+			if constexpr (debug) {
+				cerr << name << ": invalid " << (value == NULL ?
+					"value" : "visitor") << " (NULL)" << "\n";
+			}
+			return false;
+		}
+
+		NameList names;
+		bool found;
+		{
+			ReadHandle poset(id, true);
+			if (!poset) {
+				//Poset with the given id doesn't exist.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << " does not exist"
+						<< "\n";
+				}
+				return false;
+			}
+
+			auto walk = [&](const auto& posetOrFile) {
+				element_id element = findElement(posetOrFile, value);
+				if (element == noElement) {
+					return false;
+				}
+				else if (!upward || covers ||
+					!enumerateRow(posetOrFile, element, names)) {
+					enumerate(posetOrFile, upward ? posetOrFile.children :
+						posetOrFile.parents, element, covers, names);
+				}
+				return true;
+			};
+			if (const MappedFile* file = poset.mappedFile()) {
+				found = walk(PosetFile(file->data()));
+			}
+			else {
+				found = walk(*poset);
+			}
+		}
+		//The lock is released, so the visitor may use the poset as well.
+		names.visitAll(visit, context);
+
+		if constexpr (debug) {
+			if (found) {
+				cerr << name << ": poset " << id << ", element " << s
+					<< " enumerated" << "\n";
+			}
+			else {
+				cerr << name << ": poset " << id << ", element " << s
+					<< " does not exist" << "\n";
+			}
+		}
+		return found;
+	}
+}
+
+bool cxx::poset_upper_set(unsigned long id, char const* value,
+	poset_visitor visit, void* context) {
+	return posetEnumerate("poset_upper_set", id, value, true, false, visit,
+		context);
+}
+
+bool cxx::poset_lower_set(unsigned long id, char const* value,
+	poset_visitor visit, void* context) {
+	return posetEnumerate("poset_lower_set", id, value, false, false, visit,
+		context);
+}
+
+bool cxx::poset_upper_covers(unsigned long id, char const* value,
+	poset_visitor visit, void* context) {
+	return posetEnumerate("poset_upper_covers", id, value, true, true, visit,
+		context);
+}
+
+bool cxx::poset_lower_covers(unsigned long id, char const* value,
+	poset_visitor visit, void* context) {
+	return posetEnumerate("poset_lower_covers", id, value, false, true, visit,
+		context);
+}
+
+namespace {
+	bool posetExtremes(char const* name, unsigned long id, bool minimal,
+		cxx::poset_visitor visit, void* context) {
+		if constexpr (debug) {
+			cerr << name << "(" << id << ")" << "\n";
+		}
+
+		if (visit == NULL) {
+			//We can't report anything.
+			if constexpr (debug) {
+				cerr << name << ": invalid visitor (NULL)" << "\n";
+			}
+			return false;
+		}
+
+		NameList names;
+		{
+			ReadHandle poset(id, true);
+			if (!poset) {
+				//Poset with the given id doesn't exist.
+				if constexpr (debug) {
+					cerr << name << ": poset " << id << " does not exist"
+						<< "\n";
+				}
+				return false;
+			}
+
+			if (const MappedFile* mapped = poset.mappedFile()) {
+				//Files keep no sets, but the rows tell the degrees at once.
+				PosetFile file(mapped->data());
+				for (element_id e = 0; e < file.size(); ++e) {
+					IndexRange relations = minimal ? file.parents[e] :
+						file.children[e];
+					if (relations.size() == 0) {
+						names.add(file.name(e));
+					}
+				}
+			}
+			else {
+				for (element_id e : minimal ? poset->minimal.items :
+					poset->maximal.items) {
+					names.add(poset->names[e]);
+				}
+			}
+		}
+		//The lock is released, so the visitor may use the poset as well.
+		names.visitAll(visit, context);
 
-	if constexpr (debug) {
-		cerr << "poset_new: poset " << id << " created" << "\n";
+		if constexpr (debug) {
+			cerr << name << ": poset " << id << " enumerated" << "\n";
+		}
+		return true;
 	}
+}
 
-	return id;
+bool cxx::poset_minimal(unsigned long id, poset_visitor visit,
+	void* context) {
+	return posetExtremes("poset_minimal", id, true, visit, context);
 }
 
-size_t cxx::poset_size(unsigned long id) {
+bool cxx::poset_maximal(unsigned long id, poset_visitor visit,
+	void* context) {
+	return posetExtremes("poset_maximal", id, false, visit, context);
+}
+
+bool cxx::poset_linear_extension(unsigned long id, poset_visitor visit,
+	void* context) {
 	if constexpr (debug) {
-		cerr << "poset_size(" << id << ")" << "\n";
+		cerr << "poset_linear_extension(" << id << ")" << "\n";
 	}
 
-	if (findKeyInElements(id)) {
+	if (visit == NULL) {
+		//We can't report anything.
 		if constexpr (debug) {
-			cerr << "poset_size: poset " << id
-				<< " contains " << poset_elements()[id].size()
-				<< " element(s)" << "\n";
+			cerr << "poset_linear_extension: invalid visitor (NULL)" << "\n";
 		}
-		return poset_elements()[id].size();
+		return false;
 	}
-	else {
+
+	//The order is copied out, so the visitor runs with no lock held.
+	NameList names;
+	auto collect = [&](const Poset& poset) {
+		for (element_id e : poset.extension) {
+			if (e != noElement) {
+				names.add(poset.names[e]);
+			}
+		}
 		if constexpr (debug) {
-			cerr << "poset_size: poset " << id
-				<< " does not exist" << "\n";
+			cerr << "poset_linear_extension: poset " << id << ", "
+				<< poset.ids.size() << " element(s) ordered" << "\n";
 		}
+	};
+	bool collected = false;
+	{
+		//Usually the cached extension is up to date, and can be read
+		//in parallel with the other readers.
+		ReadHandle poset(id);
+		if (poset && poset->extensionValid) {
+			collect(*poset);
+			collected = true;
+		}
+	}
 
-		return 0;
+	if (!collected) {
+		WriteHandle poset(id);
+		if (!poset) {
+			//Poset with the given id doesn't exist.
+			if constexpr (debug) {
+				cerr << "poset_linear_extension: poset " << id
+					<< " does not exist" << "\n";
+			}
+			return false;
+		}
+		if (!poset->extensionValid) {
+			buildExtension(*poset);
+			//Snapshot was copied without the extension.
+			retireSnapshot(poset.posetEntry());
+		}
+		collect(*poset);
 	}
+	names.visitAll(visit, context);
+	return true;
 }
 
-bool cxx::poset_remove(unsigned long id, char const* value) {
-	string s = ifNULL(value);
-
+size_t cxx::poset_test_many(unsigned long id, size_t count,
+	char const* const* values1, char const* const* values2, bool* results) {
+	CallRecorder call(POSET_OP_TEST);
 	if constexpr (debug) {
-		cerr << "poset_remove(" << id << ", " << s << ")" << "\n";
+		cerr << "poset_test_many(" << id << ", " << count << ")" << "\n";
 	}
 
-	if (value == NULL) {
-		//We can't remove NULL;
+	if (values1 == NULL || values2 == NULL || results == NULL) {
+		//We can't read values or write results.
 		if constexpr (debug) {
-			cerr << "poset_remove: invalid value (NULL)" << "\n";
+			cerr << "poset_test_many: invalid array (NULL)" << "\n";
 		}
-
-		return false;
+		return call.finishBatch(count, 0);
 	}
 
-	//Poset with the given id doesn't exist.
-	if (!findKeyInElements(id)) {
+	ReadHandle poset(id, true);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
+		std::fill_n(results, count, false);
 		if constexpr (debug) {
-			cerr << "poset_remove: " << "poset " << id
+			cerr << "poset_test_many: poset " << id
 				<< " does not exist" << "\n";
 		}
-
-		return false;
+		return call.finishBatch(count, 0);
 	}
-	else if (findValueInPoset(id, value)) {
-		//Poset exists and is not empty and the value is in poset.
-		bool bIsParentInCollection = findValueInCollection(id, value);
-		auto elementToRemove = poset_elements()[id].find(value);
-		for (auto& pair : poset_collection()[id]) {
-			if (pair.second.find(&*elementToRemove) != pair.second.end()) {
-				//Value is the parent of something, 
-				//we need to re-map the relation.
-				if (bIsParentInCollection) {
-					for (const string* s : poset_collection()[id]
-						[&*elementToRemove]) {
-						pair.second.insert(s);
-					}
-				}
-				pair.second.erase(pair.second.find(&*elementToRemove));
+
+	size_t related = 0;
+	auto testAll = [&](const auto& posetOrFile) {
+		for (size_t i = 0; i < count; ++i) {
+			element_id element1 = noElement;
+			element_id element2 = noElement;
+			if (values1[i] != NULL && values2[i] != NULL) {
+				element1 = findElement(posetOrFile, values1[i]);
+				element2 = findElement(posetOrFile, values2[i]);
+			}
+			results[i] = element1 != noElement && element2 != noElement &&
+				(element1 == element2 ||
+					isBefore(posetOrFile, element1, element2));
+			if (results[i]) {
+				++related;
 			}
 		}
-		if (bIsParentInCollection) {
-			//If value was a parent of something, we need to remove it
-			//from the poset_collection.
-			poset_collection()[id].erase(
-				poset_collection()[id].find(&*elementToRemove));
-		}
-		//Remove element from th list of the poset's elements.
-		poset_elements()[id].erase(value);
-		if constexpr (debug) {
-			cerr << "poset_remove: poset " << id << ", element " << s
-				<< " removed" << "\n";
-		}
-		return true;
+	};
+	if (const MappedFile* file = poset.mappedFile()) {
+		testAll(PosetFile(file->data()));
 	}
 	else {
-		if constexpr (debug) {
-			cerr << "poset_remove: poset " << id << ", element " << s
-				<< " does not exist" << "\n";
-		}
+		testAll(*poset);
+	}
 
-		return false;
+	if constexpr (debug) {
+		cerr << "poset_test_many: poset " << id << ", " << related
+			<< " of " << count << " relation(s) exist" << "\n";
 	}
+	return call.finishBatch(count, related);
 }
 
-bool cxx::poset_del(unsigned long id, char const* value1,
-	char const* value2) {
-	string s1 = ifNULL(value1);
-	string s2 = ifNULL(value2);
-
+bool cxx::poset_set_test_cache(unsigned long id, size_t slots) {
 	if constexpr (debug) {
-		cerr << "poset_del(" << id << ", " << s1 << ", " << s2 << ")" << "\n";
+		cerr << "poset_set_test_cache(" << id << ", " << slots << ")" << "\n";
 	}
 
-	if (value1 == NULL || value2 == NULL) {
-		//We can't delete relation between NULLs.
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
 		if constexpr (debug) {
-			if (value1 == NULL) {
-				cerr << "poset_del: invalid value1 (NULL)" << "\n";
-			}
+			cerr << "poset_set_test_cache: poset " << id
+				<< " does not exist" << "\n";
+		}
+		return false;
+	}
 
-			if (value2 == NULL) {
-				cerr << "poset_del: invalid value2 (NULL)" << "\n";
-			}
+	size_t size = 0;
+	if (slots > 0) {
+		size = 1;
+		while (size < slots && size < (size_t(1) << 32)) {
+			size *= 2;
 		}
+	}
+	TestCache* cache = size > 0 ? new TestCache(size) : nullptr;
+	TestCache* old = poset.posetEntry().testCache.exchange(cache);
+	if (old != nullptr) {
+		//Readers may still look answers up in it.
+		retire([old]() { delete old; });
+	}
 
-		return false;
+	if constexpr (debug) {
+		cerr << "poset_set_test_cache: poset " << id << ", cache of " << size
+			<< " answer(s)" << "\n";
+	}
+	return true;
+}
+
+bool cxx::poset_set_snapshots(unsigned long id, bool enabled) {
+	if constexpr (debug) {
+		cerr << "poset_set_snapshots(" << id << ", "
+			<< (enabled ? "true" : "false") << ")" << "\n";
 	}
 
-	if (!findKeyInElements(id)) {//Poset doesn't exist.
+	WriteHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id
+			cerr << "poset_set_snapshots: poset " << id
 				<< " does not exist" << "\n";
 		}
 		return false;
 	}
-	else if (!findValueInPoset(id, value1)) {//Value1 doesn't exist.
+
+	PosetEntry& entry = poset.posetEntry();
+	entry.snapshotsEnabled = enabled;
+	if (enabled) {
+		publishSnapshot(entry);
+	}
+	else {
+		retireSnapshot(entry);
+	}
+
+	if constexpr (debug) {
+		cerr << "poset_set_snapshots: poset " << id << ", snapshots "
+			<< (enabled ? "enabled" : "disabled") << "\n";
+	}
+	return true;
+}
+
+bool cxx::poset_stats(unsigned long id, struct poset_stats* stats) {
+	if constexpr (debug) {
+		cerr << "poset_stats(" << id << ")" << "\n";
+	}
+
+	if (stats == NULL) {
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id << ", element " << s1
-				<< " does not exist" << "\n";
+			cerr << "poset_stats: invalid stats (NULL)" << "\n";
 		}
 		return false;
 	}
-	else if (!findValueInPoset(id, value2)) {//Value2 doesn't exist.
+
+	EpochGuard guard;
+	PosetEntry* entry = findPoset(id);
+	if (entry == nullptr) {
+		//Poset with the given id doesn't exist.
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id << ", element " << s2
-				<< " does not exist" << "\n";
+			cerr << "poset_stats: poset " << id << " does not exist" << "\n";
 		}
 		return false;
 	}
 
-	//Both values exist in the given poset.
-	if (strcmp(value1, value2) == 0) {
-		//We can't delete a->a relation.
+	std::memset(stats, 0, sizeof(*stats));
+	readCounters(entry->stats, *stats);
+	if constexpr (debug) {
+		cerr << "poset_stats: poset " << id << ", statistics read" << "\n";
+	}
+	return true;
+}
+
+void cxx::poset_global_stats(struct poset_stats* stats) {
+	if constexpr (debug) {
+		cerr << "poset_global_stats()" << "\n";
+	}
+
+	if (stats == NULL) {
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id << ", relation ("
-				<< s1 << ", " << s2 << ") cannot be deleted" << "\n";
+			cerr << "poset_global_stats: invalid stats (NULL)" << "\n";
 		}
-		return false;
+		return;
 	}
-	auto value1Iter = poset_elements()[id].find(value1);
-	auto value2Iter = poset_elements()[id].find(value2);
-
-	if (poset_collection()[id][&*value1Iter]
-		.find(&*value2Iter) !=
-		poset_collection()[id][&*value1Iter].end()) {
-		//Value1 and Value2 are in a relation.
-		for (const string* elem : poset_collection()[id][&*value1Iter]) {
-			if (elem != &*value2Iter) {
-				//Value2 isn't strictly after ther
-				//value1 in the relation chain.
-				if (findParent(id, elem, value2)) {
-					//If we have following relations: b->c, c->d, b->d,
-					//then we can't delete the relation.
-					if constexpr (debug) {
-						cerr << "poset_del: poset " << id << ", relation ("
-							<< s1 << ", " << s2 <<
-							") cannot be deleted" << "\n";
-					}
-					return false;
-				}
-			}
-		}
-		for (auto& pair : poset_collection()[id]) {
-			if (pair.second.find(&*value1Iter) !=
-				pair.second.end()) {
-				//a->b->c, deleting b->c, we need to remap it so that a->c.
-				pair.second.insert(&*value2Iter);
-			}
-		}
-		if (findValueInCollection(id, value2)) {
-			//a->b->c, deleting a->b, we need to remap it so that a->c
-			for (const string* elem : (poset_collection()[id][&*value2Iter])) {
-				poset_collection()[id][&*value1Iter].insert(elem);
-			}
-		}
-		poset_collection()[id][&*value1Iter].erase(&*value2Iter);
 
+	std::memset(stats, 0, sizeof(*stats));
+	for (ThreadStats* block = threadStatsList().load(); block != nullptr;
+		block = block->next) {
+		readCounters(block->counters, *stats);
+	}
+}
+
+bool cxx::poset_save(unsigned long id, char const* path, bool checksum) {
+	if constexpr (debug) {
+		cerr << "poset_save(" << id << ", " << ifNULL(path, valueLength(path))
+			<< ", " << (checksum ? "true" : "false") << ")" << "\n";
+	}
+
+	if (path == NULL) {
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id << ", relation (" <<
-				s1 << ", " << s2 << ") deleted" << "\n";
+			cerr << "poset_save: invalid path (NULL)" << "\n";
 		}
-
-		return true;
+		return false;
 	}
-	else {
-		//Elements aren't in a relation, we delete nothing.
+
+	ReadHandle poset(id);
+	if (!poset) {
+		//Poset with the given id doesn't exist.
 		if constexpr (debug) {
-			cerr << "poset_del: poset " << id << ", relation ("
-				<< s1 << ", " << s2 << ") cannot be deleted" << "\n";
+			cerr << "poset_save: poset " << id << " does not exist" << "\n";
 		}
 		return false;
 	}
-}
 
-void cxx::poset_delete(unsigned long id) {
+	FILE* file = fopen(path, "wb");
+	bool saved = file != nullptr && savePoset(*poset, file, checksum);
+	saved = file != nullptr && fclose(file) == 0 && saved;
+
 	if constexpr (debug) {
-		cerr << "poset_delete(" << id << ")" << "\n";
+		cerr << "poset_save: poset " << id
+			<< (saved ? " saved" : " not saved") << "\n";
 	}
+	return saved;
+}
 
-	auto posetToDeleteIter = poset_collection().find(id);
-	auto posetElementsToDeleteIter = poset_elements().find(id);
+bool cxx::poset_load(char const* path, unsigned long* id) {
+	if constexpr (debug) {
+		cerr << "poset_load(" << ifNULL(path, valueLength(path)) << ")"
+			<< "\n";
+	}
 
-	if (posetToDeleteIter != poset_collection().end()) {
-		//We found the given poset in the poset_collection.
-		poset_collection().erase(posetToDeleteIter);
+	vector<char> data;
+	if (path == NULL || id == NULL || !readFile(path, data)) {
+		if constexpr (debug) {
+			cerr << "poset_load: cannot read " << ifNULL(path,
+				valueLength(path)) << "\n";
+		}
+		return false;
 	}
 
-	if (posetElementsToDeleteIter != poset_elements().end()) {
-		//We found poset's elements in the poset_elements.
-		poset_elements().erase(posetElementsToDeleteIter);
+	//The poset is built before it's registered, so nobody can see it
+	//half-loaded, and no lock is needed.
+	auto entry = std::make_unique<PosetEntry>();
+	if (!checkPosetFile(data.data(), data.size(), true) ||
+		!loadPoset(entry->poset, data.data())) {
 		if constexpr (debug) {
-			cerr << "poset_delete: poset " << id << " deleted" << "\n";
+			cerr << "poset_load: " << ifNULL(path, valueLength(path))
+				<< " is not a valid poset file" << "\n";
 		}
+		return false;
 	}
-	else if constexpr (debug) {
-		//If pose isn't in poset_elements, it means that it doesn't exist.
-		cerr << "poset_delete: poset " << id << " does not exist" << "\n";
+
+	*id = registerPoset(std::move(entry));
+
+	if constexpr (debug) {
+		cerr << "poset_load: poset " << *id << " loaded" << "\n";
 	}
+	return true;
 }
 
-bool cxx::poset_insert(unsigned long id, char const* value) {
-	string s = ifNULL(value);
-
+bool cxx::poset_map(char const* path, bool verify, unsigned long* id) {
 	if constexpr (debug) {
-		cerr << "poset_insert(" << id << ", " << s << ")" << "\n";
+		cerr << "poset_map(" << ifNULL(path, valueLength(path)) << ", "
+			<< (verify ? "true" : "false") << ")" << "\n";
 	}
 
-	if (value == NULL) {
-		//We can't add null value;
+	unique_ptr<MappedFile> file(path != NULL && id != NULL ?
+		MappedFile::open(path) : nullptr);
+	if (file == nullptr) {
 		if constexpr (debug) {
-			cerr << "poset_insert: invalid value (NULL)" << "\n";
+			cerr << "poset_map: cannot map " << ifNULL(path,
+				valueLength(path)) << "\n";
 		}
 		return false;
 	}
-	else if (findKeyInElements(id)) {
-		//We found the given poset, we can try to insert a new
-		//element into it.
-		if (!findValueInPoset(id, value)) {
-			//Current poset doesn't contain the value, so we can 
-			//insert it into poset.
-			poset_elements()[id].insert(string(value));
-			if constexpr (debug) {
-				cerr << "poset_insert: poset " << id << ", element "
-					<< s << " inserted" << "\n";
-			}
-			return true;
-		}
-		else {//Poset already contains the value, we add nothing.
-			if constexpr (debug) {
-				cerr << "poset_insert: poset " << id << ", element "
-					<< s << " already exists" << "\n";
-			}
-			return false;
-		}
-	}
-	else {//We inserted nothing, because the given poset doesn't exist.
+	if (!checkPosetFile(file->data(), file->size(), verify)) {
 		if constexpr (debug) {
-			cerr << "poset_insert: poset " << id <<
-				" does not exist" << "\n";
+			cerr << "poset_map: " << ifNULL(path, valueLength(path))
+				<< " is not a valid poset file" << "\n";
 		}
 		return false;
 	}
-}
 
-bool cxx::poset_add(unsigned long id, char const* value1,
-	char const* value2) {
-	string s1 = ifNULL(value1);
-	string s2 = ifNULL(value2);
+	auto entry = std::make_unique<PosetEntry>();
+	entry->mapped.store(file.release());
+	*id = registerPoset(std::move(entry));
 
 	if constexpr (debug) {
-		cerr << "poset_add(" << id << ", " << s1 << ", "
-			<< s2 << ")" << "\n";
+		cerr << "poset_map: poset " << *id << " mapped" << "\n";
 	}
+	return true;
+}
 
-	if (value1 == NULL || value2 == NULL) {
-		//We can't delete relation between NULLs.
-		if constexpr (debug) {
-			if (value1 == NULL) {
-				cerr << "poset_add: invalid value1 (NULL)" << "\n";
-			}
+bool cxx::poset_clone(unsigned long id, unsigned long* clone) {
+	if constexpr (debug) {
+		cerr << "poset_clone(" << id << ")" << "\n";
+	}
 
-			if (value2 == NULL) {
-				cerr << "poset_add: invalid value2 (NULL)" << "\n";
-			}
+	if (clone == NULL) {
+		if constexpr (debug) {
+			cerr << "poset_clone: invalid clone (NULL)" << "\n";
 		}
-
 		return false;
 	}
-	else if (findKeyInCollection(id)) {
-		//Poset with the given id exists.
-		if (!findValueInPoset(id, value1)) {
-			//Value1 is not in the poset.
-			if constexpr (debug) {
-				cerr << "poset_add: poset " << id << ", element " << s1
-					<< " does not exist" << "\n";
-			}
-			return false;
+
+	EpochGuard guard;
+	PosetEntry* entry = findPoset(id);
+	if (entry == nullptr) {
+		if constexpr (debug) {
+			cerr << "poset_clone: poset " << id << " does not exist" << "\n";
 		}
-		else if (!findValueInPoset(id, value2)) {
-			//Value2 is not in the poset.
+		return false;
+	}
+
+	auto copy = std::make_unique<PosetEntry>();
+	{
+		std::unique_lock<shared_mutex> lock(entry->mutex);
+		if (!promoteMapped(*entry)) {
 			if constexpr (debug) {
-				cerr << "poset_add: poset " << id << ", element " << s2
-					<< " does not exist" << "\n";
+				cerr << "poset_clone: poset " << id << " cannot be cloned"
+					<< "\n";
 			}
 			return false;
 		}
-		else {
-			//Both values are in the poset.
-			if (strcmp(value1, value2) == 0) {
-				//We are trying to add a relation betweene the same element,
-				//and that relation already exists.
-				if constexpr (debug) {
-					cerr << "poset_add: poset " << id << ", relation (" << s1
-						<< ", " << s2 << ") cannot be added" << "\n";
-				}
-				return false;
-			}
-			else if ((findValueInCollection(id, value1) &&
-				findParent(id, value1, value2)) ||
-				(findValueInCollection(id, value2) &&
-					findParent(id, value2, value1))) {
-				//if value2 is already a parent of the value 1, or value1
-				//is a parent of the value2, we don't want 
-				//to add a new relation.
-				if constexpr (debug) {
-					cerr << "poset_add: poset " << id << ", relation (" << s1
-						<< ", " << s2 << ") cannot be added" << "\n";
-				}
-				return false;
-			}
-			else {//Adds value2 to the set containing children of the value1.
-				auto value1Iter = poset_elements()[id].find(value1);
-				auto value2Iter = poset_elements()[id].find(value2);
-				poset_collection()[id][&*value1Iter]
-					.insert(&*value2Iter);
-				if constexpr (debug) {
-					cerr << "poset_add: poset " << id << ", relation (" << s1
-						<< ", " << s2 << ") added" << "\n";
-				}
-				return true;
-			}
+		//Only the pointers to the chunks are copied. Either poset copies
+		//the chunks it modifies later.
+		copy->poset = entry->poset;
+		copy->snapshotsEnabled = entry->snapshotsEnabled.load();
+		//The clone caches its own answers, in a cache of the same size.
+		if (TestCache* cache = entry->testCache.load()) {
+			copy->testCache.store(new TestCache(cache->size()));
 		}
 	}
-	else {
-		//Poset with the given id doesn't exist.
-		if constexpr (debug) {
-			cerr << "poset_add: poset " << id << " does not exist" << "\n";
-		}
-		return false;
+
+	*clone = registerPoset(std::move(copy));
+
+	if constexpr (debug) {
+		cerr << "poset_clone: poset " << *clone << " cloned from " << id
+			<< "\n";
 	}
+	return true;
 }
 
-bool cxx::poset_test(unsigned long id, char const* value1,
-	char const* value2) {
-	string s1 = ifNULL(value1);
-	string s2 = ifNULL(value2);
+void cxx::poset_trace_enable(bool enabled) {
+	if constexpr (debug) {
+		cerr << "poset_trace_enable(" << (enabled ? "true" : "false") << ")"
+			<< "\n";
+	}
 
+	traceEnabled() = enabled;
+}
+
+long cxx::poset_trace_dump(char const* path) {
 	if constexpr (debug) {
-		cerr << "poset_test(" << id << ", " << s1 << ", " << s2
-			<< ")" << "\n";
+		cerr << "poset_trace_dump(" << ifNULL(path, valueLength(path)) << ")"
+			<< "\n";
 	}
 
-	if (value1 == NULL || value2 == NULL) {
-		//We can't delete relation between NULLs.
+	if (path == NULL) {
 		if constexpr (debug) {
-			if (value1 == NULL) {
-				cerr << "poset_test: invalid value1 (NULL)" << "\n";
-			}
-
-			if (value2 == NULL) {
-				cerr << "poset_test: invalid value2 (NULL)" << "\n";
-			}
+			cerr << "poset_trace_dump: invalid path (NULL)" << "\n";
 		}
-
-		return false;
+		return -1;
 	}
-	else if (findKeyInCollection(id)) {
-		//Poset with the given id exists.
-		if (strcmp(value1, value2) == 0) {
-			//value1 is equal to value2.
-			if (findValueInPoset(id, value1)) {
-				//value1 exists and is in relation with itself.
-				if constexpr (debug) {
-					cerr << "poset_test: poset " << id << ", relation ("
-						<< s1 << ", " << s1 << ")" << " exists" << "\n";
-				}
-				return true;
-			}
-			else {
-				//value1 is not in the given poset.
-				if constexpr (debug) {
-					cerr << "poset_test: poset " << id << ", element "
-						<< s2 << " does not exist" << "\n";
-				}
-				return false;
-			}
-		}
-		else if (!findValueInPoset(id, value1)) {
-			//Value1 is not in the given poset.
-			if constexpr (debug) {
-				cerr << "poset_test: poset " << id << ", element "
-					<< s1 << " does not exist" << "\n";
-			}
-			return false;
-		}
-		else if (!findValueInPoset(id, value2)) {
-			//Value2 is not in the given poset.
-			if constexpr (debug) {
-				cerr << "poset_test: poset " << id << ", element "
-					<< s2 << " does not exist" << "\n";
+
+	//Copy the rings first, so the file is written without racing
+	//the threads which keep tracing.
+	vector<poset_trace_record> records;
+	for (TraceRing* ring = traceRings().load(); ring != nullptr;
+		ring = ring->next) {
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t first = head > TraceRing::capacity ?
+			head - TraceRing::capacity : 0;
+		vector<uint64_t> words;
+		words.reserve((head - first) * TraceRing::words);
+		for (uint64_t i = first; i < head; ++i) {
+			const std::atomic<uint64_t>* record = ring->records +
+				(i % TraceRing::capacity) * TraceRing::words;
+			for (size_t w = 0; w < TraceRing::words; ++w) {
+				words.push_back(record[w].load(std::memory_order_relaxed));
 			}
-			return false;
 		}
-		else {
-			//Both values are in the poset.
-			if (findValueInCollection(id, value1) &&
-				findParent(id, value1, value2)) {
-				//Value1 is a parent of the value2.
-				if constexpr (debug) {
-					cerr << "poset_test: poset " << id << ", relation ("
-						<< s1 << ", " << s2 << ")" << " exists" << "\n";
-				}
-				return true;
-			}
-			else {//Value1 is not a parent of the value2.
-				if constexpr (debug) {
-					cerr << "poset_test: poset " << id << ", relation ("
-						<< s1 << ", " << s2 << ")" <<
-						" does not exist" << "\n";
-				}
-				return false;
-			}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//Records the owner could have overwritten while they were copied.
+		uint64_t newHead = ring->head.load(std::memory_order_relaxed);
+		uint64_t valid = newHead >= TraceRing::capacity ?
+			newHead - TraceRing::capacity + 1 : 0;
+		for (uint64_t i = std::max(first, valid); i < head; ++i) {
+			const uint64_t* word = words.data() + (i - first) * TraceRing::words;
+			poset_trace_record record;
+			record.timestamp_ns = word[0];
+			record.poset_id = word[1];
+			record.element1 = static_cast<uint32_t>(word[2]);
+			record.element2 = static_cast<uint32_t>(word[2] >> 32);
+			record.op = static_cast<uint16_t>(word[3]);
+			record.result = static_cast<uint16_t>(word[3] >> 16);
+			record.thread = static_cast<uint32_t>(word[3] >> 32);
+			records.push_back(record);
 		}
 	}
-	else {
-		//Poset with the given id doesn't exist.
+
+	FILE* file = std::fopen(path, "wb");
+	if (file == nullptr) {
 		if constexpr (debug) {
-			cerr << "poset_test: poset " << id << " does not exist" << "\n";
+			cerr << "poset_trace_dump: cannot open " << ifNULL(path,
+				valueLength(path)) << "\n";
 		}
-		return false;
+		return -1;
 	}
-}
+	poset_trace_header header = { POSET_TRACE_MAGIC, POSET_TRACE_VERSION,
+		sizeof(poset_trace_record), 0, records.size() };
+	bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+		std::fwrite(records.data(), sizeof(poset_trace_record),
+			records.size(), file) == records.size();
+	written = std::fclose(file) == 0 && written;
 
-void cxx::poset_clear(unsigned long id) {
 	if constexpr (debug) {
-		cerr << "poset_clear(" << id << ")" << "\n";
-	}
-
-	if (findKeyInElements(id)) {
-		//Poset with the given id exists.
-		poset_elements()[id].clear();
-		poset_collection()[id].clear();
-		if constexpr (debug) {
-			cerr << "poset_clear: poset " << id << " cleared" << "\n";
-		}
+		cerr << "poset_trace_dump: " << records.size() << " record(s) "
+			<< (written ? "written" : "not written") << "\n";
 	}
-	else if constexpr (debug) {//Poset with the given id doesn't exists.
-		cerr << "poset_clear: poset " << id << " does not exist" << "\n";
-	}
-}
\ No newline at end of file
+	return written ? static_cast<long>(records.size()) : -1;
+}
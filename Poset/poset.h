@@ -9,14 +9,74 @@
 #include <cstdlib>
 #endif
 
+/*
+* Number of buckets of the latency histograms in struct poset_op_stats.
+*/
+#define POSET_LATENCY_BUCKETS 32
+
 #ifdef __cplusplus
 namespace cxx {
 	extern "C" {
 #endif
+		/*
+		* Functions counted separately by poset_stats.
+		*/
+		enum poset_op {
+			POSET_OP_NEW,
+			POSET_OP_DELETE,
+			POSET_OP_SIZE,
+			POSET_OP_INSERT,
+			POSET_OP_REMOVE,
+			POSET_OP_ADD,
+			POSET_OP_DEL,
+			POSET_OP_TEST,
+			POSET_OP_CLEAR,
+			POSET_OP_COMPARE,
+			POSET_OP_COUNT
+		};
+
+		/*
+		* Statistics of a single function. Calls which returned true (or,
+		* for the functions returning no bool, found their poset) count as
+		* successes. latency[i] counts the calls which took from 2^i to
+		* 2^(i + 1) nanoseconds. Batch functions count every value as a call,
+		* but don't add latency samples.
+		*/
+		struct poset_op_stats {
+			unsigned long long calls;
+			unsigned long long successes;
+			unsigned long long failures;
+			unsigned long long total_ns;
+			unsigned long long latency[POSET_LATENCY_BUCKETS];
+		};
+
+		/*
+		* Statistics of a poset, or of the whole library. Besides the calls,
+		* it counts the searches done to check the relations, together with
+		* the number of elements they visited and relations they scanned,
+		* and the answers of poset_test found in the caches set up by
+		* poset_set_test_cache (hits) or missing from them (misses).
+		*/
+		struct poset_stats {
+			struct poset_op_stats ops[POSET_OP_COUNT];
+			unsigned long long searches;
+			unsigned long long nodes_visited;
+			unsigned long long edges_scanned;
+			unsigned long long cache_hits;
+			unsigned long long cache_misses;
+		};
+
+		/*
+		* All functions below may be called concurrently. Calls reading
+		* the same poset run in parallel, calls modifying it are serialized,
+		* and calls on different posets don't block each other.
+		*/
+
 		/*
 		* poset_new() creates new poset, add it to the
-		* poset_collection and poset_elements structures
-		* and returns its id.
+		* poset_collection structure and returns its id.
+		* Ids of the deleted posets stay invalid, even after new posets
+		* take their places in the poset_collection.
 		*/
 		unsigned long poset_new(void);
 
@@ -39,6 +99,13 @@ namespace cxx {
 		*/
 		bool poset_insert(unsigned long id, char const* value);
 
+		/*
+		* Same as poset_insert, but the value is given by its length,
+		* so it doesn't have to be null-terminated.
+		*/
+		bool poset_insert_n(unsigned long id, char const* value,
+			size_t length);
+
 		/*
 		* Removes the given value and all its relations from the given poset.
 		* If the given poset or value doesn't exist, this function returns
@@ -46,6 +113,12 @@ namespace cxx {
 		*/
 		bool poset_remove(unsigned long id, char const* value);
 
+		/*
+		* Same as poset_remove, but the value is given by its length.
+		*/
+		bool poset_remove_n(unsigned long id, char const* value,
+			size_t length);
+
 		/*
 		* If a poset with the given id exists, and both of the provided values
 		* aren't contained inside it, this function adds them to the poset
@@ -56,6 +129,12 @@ namespace cxx {
 		bool poset_add(unsigned long id, char const* value1, 
 			char const* value2);
 
+		/*
+		* Same as poset_add, but the values are given by their lengths.
+		*/
+		bool poset_add_n(unsigned long id, char const* value1,
+			size_t length1, char const* value2, size_t length2);
+
 		/*
 		* If poset with the given id exists, and so do value1 and value2, AND 
 		* value1 is th eparent of the value2, AND the removal of the relation
@@ -65,6 +144,12 @@ namespace cxx {
 		bool poset_del(unsigned long id, char const* value1, 
 			char const* value2);
 
+		/*
+		* Same as poset_del, but the values are given by their lengths.
+		*/
+		bool poset_del_n(unsigned long id, char const* value1,
+			size_t length1, char const* value2, size_t length2);
+
 		/*
 		* Checks whether the given poset exists, that it contains values one
 		* and two, and if value1 > value2. If all if these conditions are met,
@@ -73,11 +158,301 @@ namespace cxx {
 		bool poset_test(unsigned long id, char const* value1, 
 			char const* value2);
 
+		/*
+		* Same as poset_test, but the values are given by their lengths.
+		*/
+		bool poset_test_n(unsigned long id, char const* value1,
+			size_t length1, char const* value2, size_t length2);
+
+		/*
+		* Order of two values of a poset, as found by poset_compare.
+		* POSET_LESS means that value1 is before value2, so poset_test(id,
+		* value1, value2) returns true, and POSET_GREATER that value2 is
+		* before value1.
+		*/
+		enum poset_order {
+			POSET_LESS,
+			POSET_GREATER,
+			POSET_EQUAL,
+			POSET_INCOMPARABLE
+		};
+
+		/*
+		* Compares value1 with value2 in the given poset and stores their
+		* order in *order. Both directions are searched for at once, in
+		* a single traversal, which stops as soon as either of them is
+		* settled, so it's cheaper than calling poset_test both ways. Returns
+		* false if the poset or either value doesn't exist, or any of
+		* the pointers is NULL.
+		*/
+		bool poset_compare(unsigned long id, char const* value1,
+			char const* value2, enum poset_order* order);
+
+		/*
+		* Same as poset_compare, but the values are given by their lengths.
+		*/
+		bool poset_compare_n(unsigned long id, char const* value1,
+			size_t length1, char const* value2, size_t length2,
+			enum poset_order* order);
+
 		/*
 		* If the given poset exists, this function removes all its elements and
 		* relations between them, and otherwise, it does nothing.
 		*/
 		void poset_clear(unsigned long id);
+
+		/*
+		* Turns the closure mode of the given poset on or off. In this mode
+		* the poset keeps its whole reachability matrix, so poset_test is
+		* a single bit lookup, at the cost of n^2 / 8 bytes of memory for
+		* n elements. Returns false if the poset doesn't exist.
+		*/
+		bool poset_set_closure(unsigned long id, bool enabled);
+
+		/*
+		* Like poset_set_closure(id, true), but builds the matrix with
+		* the given number of threads, or with one thread per processor
+		* if threads is 0. Elements at the same distance from the maximal
+		* elements are merged in parallel. Does nothing if the closure mode
+		* is already on. Returns false if the poset doesn't exist.
+		*/
+		bool poset_build_closure(unsigned long id, size_t threads);
+
+		/*
+		* Visitor of the enumerated elements. Gets the element's value,
+		* which is null-terminated and stays valid only until the visitor
+		* returns, and returns false to stop the enumeration. The elements are
+		* collected first and the visitor is called with no lock held, so it
+		* may call the other functions, on the enumerated poset as well;
+		* the enumeration doesn't see the changes it makes.
+		*/
+		typedef bool (*poset_visitor)(char const* value, size_t length,
+			void* context);
+
+		/*
+		* Passes every element of the upper set of the value in the given
+		* poset, that is the value and all the elements after it, to visit
+		* together with context, in a single walk of the relation. Returns
+		* false if the poset or the value doesn't exist, or value or visit
+		* is NULL.
+		*/
+		bool poset_upper_set(unsigned long id, char const* value,
+			poset_visitor visit, void* context);
+
+		/*
+		* Like poset_upper_set, but for the value and all the elements before
+		* it (the lower set).
+		*/
+		bool poset_lower_set(unsigned long id, char const* value,
+			poset_visitor visit, void* context);
+
+		/*
+		* Like poset_upper_set, but only for the elements directly after
+		* the value, with nothing between them (the upper covers).
+		*/
+		bool poset_upper_covers(unsigned long id, char const* value,
+			poset_visitor visit, void* context);
+
+		/*
+		* Like poset_upper_covers, but for the elements directly before
+		* the value (the lower covers).
+		*/
+		bool poset_lower_covers(unsigned long id, char const* value,
+			poset_visitor visit, void* context);
+
+		/*
+		* Passes every minimal element of the given poset, with no element
+		* before it, to visit together with context. The minimal elements are
+		* kept up to date by the modifications of the poset, so they're never
+		* searched for. Returns false if the poset doesn't exist or visit
+		* is NULL.
+		*/
+		bool poset_minimal(unsigned long id, poset_visitor visit,
+			void* context);
+
+		/*
+		* Like poset_minimal, but for the maximal elements, with no element
+		* after them.
+		*/
+		bool poset_maximal(unsigned long id, poset_visitor visit,
+			void* context);
+
+		/*
+		* Passes every element of the given poset to visit together with
+		* context, in a linear extension of the poset: each element comes
+		* after all the elements before it. The order is computed by the first
+		* call and then kept up to date by the modifications of the poset,
+		* so the next calls only read it. Returns false if the poset doesn't
+		* exist or visit is NULL.
+		*/
+		bool poset_linear_extension(unsigned long id, poset_visitor visit,
+			void* context);
+
+		/*
+		* Turns the snapshot mode of the given poset on or off. In this mode
+		* poset_test, poset_test_many and poset_size read an immutable copy
+		* of the poset without taking any lock, and every modification makes
+		* the next reader build a new copy. Meant for long-lived posets which
+		* are rarely modified. Returns false if the poset doesn't exist.
+		*/
+		bool poset_set_snapshots(unsigned long id, bool enabled);
+
+		/*
+		* Makes poset_test and poset_test_n remember their last answers for
+		* the given poset, both positive and negative, in a cache of at least
+		* the given number of slots, rounded up to a power of two. Every
+		* modification of the poset invalidates the whole cache at once.
+		* Posets in the closure mode don't use it. If slots is 0, the cache
+		* is dropped. Returns false if the poset doesn't exist.
+		*/
+		bool poset_set_test_cache(unsigned long id, size_t slots);
+
+		/*
+		* Fills stats with the statistics of the calls made on the given
+		* poset since it was created. Returns false if the poset doesn't
+		* exist or stats is NULL.
+		*/
+		bool poset_stats(unsigned long id, struct poset_stats* stats);
+
+		/*
+		* Fills stats with the statistics of all the calls made so far,
+		* including the ones on the posets which were already deleted.
+		*/
+		void poset_global_stats(struct poset_stats* stats);
+
+		/*
+		* Writes the given poset to the file, in the binary format described
+		* in poset_file.h. If checksum is true, the file also gets a checksum,
+		* which poset_load verifies. Returns false if the poset doesn't exist
+		* or the file couldn't be written.
+		*/
+		bool poset_save(unsigned long id, char const* path, bool checksum);
+
+		/*
+		* Creates a new poset from the file written by poset_save, without
+		* replaying its insertions and relations one by one. On success stores
+		* the id of the new poset in id and returns true. Returns false
+		* if the file can't be read or is malformed.
+		*/
+		bool poset_load(char const* path, unsigned long* id);
+
+		/*
+		* Creates a new poset read in place from the file written by
+		* poset_save, mapped into memory. Processes mapping the same file
+		* share its pages, and poset_size, poset_test and poset_test_many
+		* are answered straight from them. The first call which modifies
+		* the poset, or needs it in memory otherwise, loads it from the file
+		* as poset_load would, and unmaps the file. If verify is false, only
+		* the header is checked, so mapping takes constant time, and the rest
+		* of the file must be trusted. If such a file turns out to be malformed
+		* when it's loaded, it stays mapped, and the calls which need
+		* the poset in memory fail as if it didn't exist. On success stores
+		* the id of the new poset in id and returns true.
+		*/
+		bool poset_map(char const* path, bool verify, unsigned long* id);
+
+		/*
+		* Creates a new poset with the same elements, relations and modes as
+		* the given one, without copying its contents. Both posets share them
+		* in chunks of a few hundred elements, and a modification of either
+		* copies only the chunks it changes, unless the other poset was
+		* deleted in the meantime. On success
+		* stores the id of the new poset in clone and returns true. Returns
+		* false if the poset doesn't exist or clone is NULL.
+		*/
+		bool poset_clone(unsigned long id, unsigned long* clone);
+
+		/*
+		* Turns tracing on or off for the whole library. While it's on, every
+		* call of the functions counted by poset_stats appends a compact
+		* binary record to the ring buffer of its thread, which keeps the last
+		* few thousand calls. Nothing is formatted until the trace is decoded.
+		*/
+		void poset_trace_enable(bool enabled);
+
+		/*
+		* Writes the records currently in the ring buffers to the given file,
+		* in the format described in poset_trace.h. Returns the number
+		* of written records, or -1 if the file couldn't be written.
+		*/
+		long poset_trace_dump(char const* path);
+
+		/*
+		* Turns the reduction mode of the given poset on or off. In this mode
+		* the poset stores only its covering relation (Hasse diagram): adding
+		* a relation deletes the ones it makes redundant, and deleting
+		* or removing re-maps only the relations no other path implies,
+		* so searches scan as few relations as possible. Enabling it
+		* compacts the poset first. Returns false if the poset doesn't exist.
+		*/
+		bool poset_set_reduction(unsigned long id, bool enabled);
+
+		/*
+		* Deletes every stored relation of the given poset which is implied
+		* by the others (computes the transitive reduction), without changing
+		* which pairs are in the relation. Returns false if the poset doesn't
+		* exist.
+		*/
+		bool poset_compact(unsigned long id);
+
+		/*
+		* Batch version of poset_insert: inserts count values into the given
+		* poset, and stores the result of each insertion in results[i].
+		* Returns the number of inserted values. If the poset doesn't exist,
+		* all results are false.
+		*/
+		size_t poset_insert_many(unsigned long id, size_t count,
+			char const* const* values, bool* results);
+
+		/*
+		* Batch version of poset_add: adds the relations
+		* (values1[i], values2[i]) in order, and stores the result of each
+		* of them in results[i], exactly as consecutive poset_add calls would.
+		* The whole batch is checked for cycles at once. Returns the number
+		* of added relations.
+		*/
+		size_t poset_add_many(unsigned long id, size_t count,
+			char const* const* values1, char const* const* values2,
+			bool* results);
+
+		/*
+		* Bulk load of relations: adds all the relations
+		* (values1[i], values2[i]) at once, inserting the values which aren't
+		* in the poset yet. Unlike poset_add_many, the batch is accepted
+		* or rejected as a whole, and is checked for cycles by a single
+		* topological sort, so loading a big graph takes linear time.
+		* Duplicated relations, relations of a value with itself, and
+		* the relations already in the poset are skipped. Returns true
+		* if the batch was added. Otherwise, the poset is left unchanged, and
+		* if cycle_length isn't NULL, it's set to the number of the given
+		* relations along the cycle the batch would create (0 if the poset
+		* doesn't exist or some value is NULL), and up to its original value
+		* of their indices are stored in cycle, in the order of the cycle.
+		* Consecutive relations of the cycle are connected either directly
+		* or through the relations already in the poset.
+		*/
+		bool poset_add_edges(unsigned long id, size_t count,
+			char const* const* values1, char const* const* values2,
+			size_t* cycle, size_t* cycle_length);
+
+		/*
+		* Version of poset_add_edges reading the relations from a text file,
+		* one per line, with both values separated by a tab. Empty lines are
+		* skipped. The relations along a cycle are reported by the numbers
+		* of their lines, counted from 1. Returns false without changing
+		* the poset if the file can't be read or some line has no tab.
+		*/
+		bool poset_add_edges_file(unsigned long id, char const* path,
+			size_t* cycle, size_t* cycle_length);
+
+		/*
+		* Batch version of poset_test: stores in results[i] whether
+		* values1[i] is before values2[i] in the given poset. Returns
+		* the number of pairs which are in the relation.
+		*/
+		size_t poset_test_many(unsigned long id, size_t count,
+			char const* const* values1, char const* const* values2,
+			bool* results);
 #ifdef __cplusplus
 	}
 }
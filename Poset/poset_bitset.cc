@@ -0,0 +1,303 @@
+#include <initializer_list>
+#include "poset_bitset.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+//MSVC compiles the intrinsics of any instruction set without flags.
+#define POSET_TARGET(isa)
+#else
+#define POSET_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+	defined(_M_IX86)
+#define POSET_BITSET_X86 1
+#include <immintrin.h>
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+	//Index of the lowest set bit of the nonzero word.
+	unsigned lowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+		unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+		_BitScanForward64(&index, bits);
+#else
+		if (!_BitScanForward(&index, static_cast<unsigned long>(bits))) {
+			_BitScanForward(&index, static_cast<unsigned long>(bits >> 32));
+			index += 32;
+		}
+#endif
+		return index;
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+
+	//Counts the bits without the popcnt instruction, which the baseline
+	//instruction sets don't have.
+	unsigned countWordBits(uint64_t bits) {
+		bits -= (bits >> 1) & 0x5555555555555555ull;
+		bits = (bits & 0x3333333333333333ull) +
+			((bits >> 2) & 0x3333333333333333ull);
+		bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return static_cast<unsigned>((bits * 0x0101010101010101ull) >> 56);
+	}
+
+	//Scans the words from the given one on, one by one.
+	size_t findNextFrom(const uint64_t* row, size_t words, size_t word) {
+		for (; word < words; ++word) {
+			if (row[word] != 0) {
+				return word * 64 + lowestBit(row[word]);
+			}
+		}
+		return words * 64;
+	}
+
+	//Looks at the first word, whose bits before from are ignored.
+	//Returns the found bit, or 0 if the search has to go on with the next
+	//word.
+	size_t findInFirstWord(const uint64_t* row, size_t from, bool& found) {
+		uint64_t bits = row[from / 64] & (~0ull << (from % 64));
+		found = bits != 0;
+		return found ? from / 64 * 64 + lowestBit(bits) : 0;
+	}
+
+	void orScalar(uint64_t* dst, const uint64_t* src, size_t words) {
+		for (size_t w = 0; w < words; ++w) {
+			dst[w] |= src[w];
+		}
+	}
+
+	size_t countScalar(const uint64_t* row, size_t words) {
+		size_t count = 0;
+		for (size_t w = 0; w < words; ++w) {
+			count += countWordBits(row[w]);
+		}
+		return count;
+	}
+
+	size_t findNextScalar(const uint64_t* row, size_t words, size_t from) {
+		if (from >= words * 64) {
+			return words * 64;
+		}
+		bool found;
+		size_t bit = findInFirstWord(row, from, found);
+		return found ? bit : findNextFrom(row, words, from / 64 + 1);
+	}
+
+#ifdef POSET_BITSET_X86
+	POSET_TARGET("avx2")
+	void orAvx2(uint64_t* dst, const uint64_t* src, size_t words) {
+		size_t w = 0;
+		for (; w + 4 <= words; w += 4) {
+			__m256i* d = reinterpret_cast<__m256i*>(dst + w);
+			__m256i s = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(src + w));
+			_mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d), s));
+		}
+		orScalar(dst + w, src + w, words - w);
+	}
+
+	//Counts the bits of every nibble with a lookup in a register (Mula's
+	//method), and sums the bytes into 64-bit lanes.
+	POSET_TARGET("avx2")
+	size_t countAvx2(const uint64_t* row, size_t words) {
+		__m256i const lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		__m256i const nibble = _mm256_set1_epi8(0x0F);
+		__m256i total = _mm256_setzero_si256();
+		size_t w = 0;
+		for (; w + 4 <= words; w += 4) {
+			__m256i v = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(row + w));
+			__m256i low = _mm256_shuffle_epi8(lookup,
+				_mm256_and_si256(v, nibble));
+			__m256i high = _mm256_shuffle_epi8(lookup,
+				_mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+			total = _mm256_add_epi64(total, _mm256_sad_epu8(
+				_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+		}
+		alignas(32) uint64_t lanes[4];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+		return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+			countScalar(row + w, words - w);
+	}
+
+	POSET_TARGET("avx2")
+	size_t findNextAvx2(const uint64_t* row, size_t words, size_t from) {
+		if (from >= words * 64) {
+			return words * 64;
+		}
+		bool found;
+		size_t bit = findInFirstWord(row, from, found);
+		if (found) {
+			return bit;
+		}
+		size_t w = from / 64 + 1;
+		for (; w + 4 <= words; w += 4) {
+			__m256i v = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i*>(row + w));
+			if (!_mm256_testz_si256(v, v)) {
+				break;
+			}
+		}
+		return findNextFrom(row, words, w);
+	}
+
+	POSET_TARGET("avx512f")
+	void orAvx512(uint64_t* dst, const uint64_t* src, size_t words) {
+		size_t w = 0;
+		for (; w + 8 <= words; w += 8) {
+			__m512i d = _mm512_loadu_si512(dst + w);
+			__m512i s = _mm512_loadu_si512(src + w);
+			_mm512_storeu_si512(dst + w, _mm512_or_si512(d, s));
+		}
+		if (w < words) {
+			__mmask8 tail = static_cast<__mmask8>((1u << (words - w)) - 1);
+			__m512i d = _mm512_maskz_loadu_epi64(tail, dst + w);
+			__m512i s = _mm512_maskz_loadu_epi64(tail, src + w);
+			_mm512_mask_storeu_epi64(dst + w, tail, _mm512_or_si512(d, s));
+		}
+	}
+
+	POSET_TARGET("avx512f,avx512bw")
+	size_t countAvx512(const uint64_t* row, size_t words) {
+		__m512i const lookup = _mm512_set4_epi32(0x04030302, 0x03020201,
+			0x03020201, 0x02010100);
+		__m512i const nibble = _mm512_set1_epi8(0x0F);
+		__m512i total = _mm512_setzero_si512();
+		size_t w = 0;
+		for (; w < words; w += 8) {
+			__mmask8 lanes = words - w >= 8 ? static_cast<__mmask8>(0xFF) :
+				static_cast<__mmask8>((1u << (words - w)) - 1);
+			__m512i v = _mm512_maskz_loadu_epi64(lanes, row + w);
+			__m512i low = _mm512_shuffle_epi8(lookup,
+				_mm512_and_si512(v, nibble));
+			__m512i high = _mm512_shuffle_epi8(lookup,
+				_mm512_and_si512(_mm512_srli_epi16(v, 4), nibble));
+			total = _mm512_add_epi64(total, _mm512_sad_epu8(
+				_mm512_add_epi8(low, high), _mm512_setzero_si512()));
+		}
+		alignas(64) uint64_t lanes[8];
+		_mm512_store_si512(lanes, total);
+		uint64_t count = 0;
+		for (uint64_t lane : lanes) {
+			count += lane;
+		}
+		return static_cast<size_t>(count);
+	}
+
+	POSET_TARGET("avx512f")
+	size_t findNextAvx512(const uint64_t* row, size_t words, size_t from) {
+		if (from >= words * 64) {
+			return words * 64;
+		}
+		bool found;
+		size_t bit = findInFirstWord(row, from, found);
+		if (found) {
+			return bit;
+		}
+		for (size_t w = from / 64 + 1; w < words; w += 8) {
+			__mmask8 lanes = words - w >= 8 ? static_cast<__mmask8>(0xFF) :
+				static_cast<__mmask8>((1u << (words - w)) - 1);
+			__m512i v = _mm512_maskz_loadu_epi64(lanes, row + w);
+			__mmask8 nonzero = _mm512_test_epi64_mask(v, v);
+			if (nonzero != 0) {
+				size_t word = w + lowestBit(nonzero);
+				return word * 64 + lowestBit(row[word]);
+			}
+		}
+		return words * 64;
+	}
+
+	//Vector instruction sets supported by both the processor and
+	//the system, which must save their registers on context switches.
+	struct CpuFeatures {
+		bool avx2 = false;
+		bool avx512 = false;
+	};
+
+	CpuFeatures detectFeatures() {
+		unsigned leaf1Ecx = 0;
+		unsigned leaf7Ebx = 0;
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		unsigned maxLeaf = static_cast<unsigned>(info[0]);
+		__cpuid(info, 1);
+		leaf1Ecx = static_cast<unsigned>(info[2]);
+		if (maxLeaf >= 7) {
+			__cpuidex(info, 7, 0);
+			leaf7Ebx = static_cast<unsigned>(info[1]);
+		}
+#else
+		unsigned eax, ebx, ecx, edx;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+			leaf1Ecx = ecx;
+		}
+		if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+			leaf7Ebx = ebx;
+		}
+#endif
+		CpuFeatures features;
+		bool osxsave = (leaf1Ecx & (1u << 27)) != 0;
+		if (!osxsave) {
+			return features;
+		}
+#if defined(_MSC_VER)
+		uint64_t xcr0 = _xgetbv(0);
+#else
+		unsigned xcr0Low, xcr0High;
+		__asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		uint64_t xcr0 = (static_cast<uint64_t>(xcr0High) << 32) | xcr0Low;
+#endif
+		//SSE and AVX state, and for AVX-512 also the opmask and upper
+		//ZMM registers.
+		bool avxState = (xcr0 & 0x06) == 0x06;
+		bool avx512State = (xcr0 & 0xE6) == 0xE6;
+		features.avx2 = avxState && (leaf7Ebx & (1u << 5)) != 0;
+		features.avx512 = avx512State && (leaf7Ebx & (1u << 16)) != 0 &&
+			(leaf7Ebx & (1u << 30)) != 0;
+		return features;
+	}
+#endif
+
+	BitsetKernels const scalarKernels{ BitsetLevel::scalar, "scalar",
+		orScalar, countScalar, findNextScalar };
+#ifdef POSET_BITSET_X86
+	BitsetKernels const avx2Kernels{ BitsetLevel::avx2, "avx2",
+		orAvx2, countAvx2, findNextAvx2 };
+	BitsetKernels const avx512Kernels{ BitsetLevel::avx512, "avx512",
+		orAvx512, countAvx512, findNextAvx512 };
+#endif
+}
+
+const BitsetKernels* bitsetKernels(BitsetLevel level) {
+#ifdef POSET_BITSET_X86
+	static CpuFeatures const features = detectFeatures();
+	if (level == BitsetLevel::avx2) {
+		return features.avx2 ? &avx2Kernels : nullptr;
+	}
+	else if (level == BitsetLevel::avx512) {
+		return features.avx512 ? &avx512Kernels : nullptr;
+	}
+#endif
+	return level == BitsetLevel::scalar ? &scalarKernels : nullptr;
+}
+
+const BitsetKernels& bitsetKernels() {
+	static const BitsetKernels& best = []() -> const BitsetKernels& {
+		for (BitsetLevel level : { BitsetLevel::avx512, BitsetLevel::avx2 }) {
+			if (const BitsetKernels* kernels = bitsetKernels(level)) {
+				return *kernels;
+			}
+		}
+		return scalarKernels;
+	}();
+	return best;
+}
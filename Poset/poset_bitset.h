@@ -0,0 +1,36 @@
+#ifndef POSET_BITSET_H
+#define POSET_BITSET_H
+
+#include <cstddef>
+#include <cstdint>
+
+//Kernels working on rows of bits stored in 64-bit words, such as the rows
+//of the closure. Every instruction set has its own table of kernels, and
+//the best one the processor supports is chosen once, with CPUID.
+
+enum class BitsetLevel {
+	scalar,
+	avx2,
+	avx512
+};
+
+struct BitsetKernels {
+	BitsetLevel level;
+	char const* name;
+	//Sets dst to dst | src.
+	void (*orWords)(uint64_t* dst, const uint64_t* src, size_t words);
+	//Returns the number of set bits of the row.
+	size_t (*countBits)(const uint64_t* row, size_t words);
+	//Returns the index of the first set bit of the row at or after from,
+	//or words * 64 if there is none.
+	size_t (*findNext)(const uint64_t* row, size_t words, size_t from);
+};
+
+//Kernels of the given level, or nullptr if the processor doesn't
+//support it.
+const BitsetKernels* bitsetKernels(BitsetLevel level);
+
+//Kernels of the best level the processor supports.
+const BitsetKernels& bitsetKernels();
+
+#endif
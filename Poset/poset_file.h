@@ -0,0 +1,66 @@
+#ifndef POSET_FILE_H
+#define POSET_FILE_H
+
+#include <stdint.h>
+
+/*
+* Binary format of the files written by poset_save. A file starts with
+* struct poset_file_header, followed by the sections it points to:
+* - names: uint64_t[elements + 1], offsets of the names in the strings
+*   section; the name of the element i ends right before the offset
+*   of the element i + 1, with the '\0' following it,
+* - children: uint64_t[elements + 1], offsets of the children of every
+*   element in the relations section (compressed sparse rows),
+* - relations: uint32_t[relations], indices of the children,
+* - parents and parent_relations: the same rows for the parents,
+* - index: uint64_t[index_slots], open addressing hash table of the names
+*   with linear probing; a slot holds the upper half of the name's hash
+*   in its upper half and the element's index in the lower one, or all
+*   ones if it's empty. Hash is the 64-bit FNV-1a of the name, and its
+*   lower bits select the first probed slot,
+* - strings: the names, each followed by '\0'.
+* Sections of integers are aligned to their size, so a mapped file can be
+* read in place. Elements are numbered from 0, in no particular order.
+* Integers are stored in the byte order of the machine which wrote
+* the file, which the magic number lets readers detect. Readers reject
+* files of the other versions.
+*/
+#define POSET_FILE_MAGIC 0x54455350u /* "PSET" */
+#define POSET_FILE_VERSION 2u
+
+/*
+* Flags of the file.
+*/
+#define POSET_FILE_CLOSURE 1u /* Poset was in the closure mode. */
+#define POSET_FILE_CHECKSUM 2u /* Checksum field is valid. */
+#define POSET_FILE_REDUCTION 4u /* Poset was in the reduction mode. */
+
+/*
+* Empty slot of the index.
+*/
+#define POSET_FILE_EMPTY_SLOT 0xFFFFFFFFFFFFFFFFull
+
+struct poset_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t header_size;
+	uint64_t file_size;
+	uint64_t elements;
+	uint64_t relations;
+	/* Offsets of the sections from the start of the file. */
+	uint64_t names_offset;
+	uint64_t children_offset;
+	uint64_t relations_offset;
+	uint64_t parents_offset;
+	uint64_t parent_relations_offset;
+	uint64_t index_offset;
+	/* Power of two greater than the number of elements. */
+	uint64_t index_slots;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	/* 64-bit FNV-1a hash of everything after the header. */
+	uint64_t checksum;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef POSET_TRACE_H
+#define POSET_TRACE_H
+
+#include <stdint.h>
+
+/*
+* Binary format of the trace files written by poset_trace_dump.
+* A file starts with struct poset_trace_header, followed by count records.
+* Records of a single thread are in the order of the calls, but records
+* of different threads are interleaved only roughly, so readers should
+* sort them by their timestamps.
+*/
+#define POSET_TRACE_MAGIC 0x52545350u /* "PSTR" */
+#define POSET_TRACE_VERSION 1u
+
+/*
+* Element field of the calls which didn't resolve that element.
+*/
+#define POSET_TRACE_NO_ELEMENT 0xFFFFFFFFu
+
+struct poset_trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t count;
+};
+
+/*
+* Single traced call. Elements are the dense indices the poset interned
+* the values as, so names never have to be copied into the trace.
+*/
+struct poset_trace_record {
+	/* Start of the call, in nanoseconds of the steady clock. */
+	uint64_t timestamp_ns;
+	uint64_t poset_id;
+	uint32_t element1;
+	uint32_t element2;
+	/* One of enum poset_op from poset.h. */
+	uint16_t op;
+	/* Value returned by the call, or whether the poset existed. */
+	uint16_t result;
+	/* Number of the ring buffer the record comes from. */
+	uint32_t thread;
+};
+
+#endif
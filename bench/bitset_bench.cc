@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <vector>
+#include "poset_bitset.h"
+
+//Microbenchmark of the bitset kernels. For every row length it runs
+//each kernel of every instruction set the processor supports, and prints
+//one JSON line per kernel with its time per call and its speedup over
+//the scalar kernel.
+//
+//Usage: bitset_bench [--words=16,256,...] [--seed=N]
+
+using std::string;
+using std::vector;
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+	struct Options {
+		vector<size_t> words{ 16, 256, 4096, 65536 };
+		unsigned seed = 1;
+	};
+
+	//Keeps the results alive, so the kernels aren't optimized out.
+	volatile uint64_t sink;
+
+	//Runs f until it took at least 20 ms, and returns the best time
+	//of a single call out of five rounds, in nanoseconds.
+	template <typename F>
+	double measure(F&& f) {
+		size_t calls = 1;
+		double best = 0;
+		for (;;) {
+			auto start = bench_clock::now();
+			for (size_t i = 0; i < calls; ++i) {
+				f();
+			}
+			double ns = std::chrono::duration<double, std::nano>(
+				bench_clock::now() - start).count();
+			if (ns >= 20e6) {
+				best = ns / calls;
+				break;
+			}
+			calls *= 2;
+		}
+		for (int round = 0; round < 4; ++round) {
+			auto start = bench_clock::now();
+			for (size_t i = 0; i < calls; ++i) {
+				f();
+			}
+			double ns = std::chrono::duration<double, std::nano>(
+				bench_clock::now() - start).count();
+			best = std::min(best, ns / calls);
+		}
+		return best;
+	}
+
+	//Times of the kernels of a single instruction set, in nanoseconds.
+	struct Times {
+		double orWords;
+		double countBits;
+		double findNext;
+	};
+
+	Times run(const BitsetKernels& kernels, size_t words, unsigned seed) {
+		std::mt19937_64 rng(seed);
+		vector<uint64_t> dst(words);
+		vector<uint64_t> src(words);
+		for (size_t w = 0; w < words; ++w) {
+			dst[w] = rng();
+			src[w] = rng();
+		}
+		//Sparse row, as the closure rows of big posets usually are:
+		//findNext has to skip long runs of zero words.
+		vector<uint64_t> sparse(words);
+		for (size_t w = 0; w < words; w += 64) {
+			sparse[w] = 1ull << (rng() % 64);
+		}
+
+		Times times;
+		times.orWords = measure([&]() {
+			kernels.orWords(dst.data(), src.data(), words);
+		});
+		times.countBits = measure([&]() {
+			sink = kernels.countBits(src.data(), words);
+		});
+		times.findNext = measure([&]() {
+			uint64_t found = 0;
+			for (size_t bit = kernels.findNext(sparse.data(), words, 0);
+				bit < words * 64;
+				bit = kernels.findNext(sparse.data(), words, bit + 1)) {
+				++found;
+			}
+			sink = found;
+		});
+		return times;
+	}
+
+	void report(const char* kernel, const char* level, size_t words,
+		double ns, double scalarNs) {
+		printf("{\"kernel\":\"%s\",\"impl\":\"%s\",\"words\":%zu,"
+			"\"ns_per_call\":%.1f,\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+			kernel, level, words, ns, words * 8 / ns, scalarNs / ns);
+		fflush(stdout);
+	}
+
+	//Splits the comma separated list.
+	vector<string> split(const string& list) {
+		vector<string> parts;
+		size_t start = 0;
+		while (start <= list.size()) {
+			size_t end = list.find(',', start);
+			if (end == string::npos) {
+				end = list.size();
+			}
+			if (end > start) {
+				parts.push_back(list.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		return parts;
+	}
+
+	bool parseOptions(int argc, char* argv[], Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			string arg = argv[i];
+			if (arg.rfind("--words=", 0) == 0) {
+				options.words.clear();
+				for (const string& words : split(arg.substr(8))) {
+					options.words.push_back(std::stoul(words));
+				}
+			}
+			else if (arg.rfind("--seed=", 0) == 0) {
+				options.seed = static_cast<unsigned>(std::stoul(arg.substr(7)));
+			}
+			else {
+				fprintf(stderr, "usage: %s [--words=16,256,...] [--seed=N]\n",
+					argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		return 1;
+	}
+
+	fprintf(stderr, "selected kernels: %s\n", bitsetKernels().name);
+	for (size_t words : options.words) {
+		if (words == 0) {
+			continue;
+		}
+		Times scalar = run(*bitsetKernels(BitsetLevel::scalar), words,
+			options.seed);
+		for (BitsetLevel level : { BitsetLevel::scalar, BitsetLevel::avx2,
+			BitsetLevel::avx512 }) {
+			const BitsetKernels* kernels = bitsetKernels(level);
+			if (kernels == nullptr) {
+				continue;
+			}
+			Times times = level == BitsetLevel::scalar ? scalar :
+				run(*kernels, words, options.seed);
+			report("or", kernels->name, words, times.orWords, scalar.orWords);
+			report("popcount", kernels->name, words, times.countBits,
+				scalar.countBits);
+			report("find_next", kernels->name, words, times.findNext,
+				scalar.findNext);
+		}
+	}
+	return 0;
+}
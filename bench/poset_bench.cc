@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "poset.h"
+
+//Benchmark of the poset library on synthetic DAGs. For every workload
+//and size it builds a poset, and prints one JSON line per measured
+//function with its throughput and latency percentiles.
+//
+//Usage: poset_bench [--sizes=10,100,...] [--workloads=chain,...]
+//	[--closure] [--seed=N]
+
+using std::string;
+using std::vector;
+using edge_list = vector<std::pair<uint32_t, uint32_t>>;
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+	struct Options {
+		vector<size_t> sizes{ 10, 100, 1000, 10000, 100000 };
+		vector<string> workloads{ "chain", "antichain", "diamond",
+			"random", "layered" };
+		bool closure = false;
+		unsigned seed = 1;
+	};
+
+	//Relations of a workload. Every relation goes from a lower to
+	//a higher index, so the graph is always acyclic.
+	edge_list makeChain(size_t n, std::mt19937&) {
+		edge_list edges;
+		for (uint32_t i = 0; i + 1 < n; ++i) {
+			edges.emplace_back(i, i + 1);
+		}
+		return edges;
+	}
+
+	edge_list makeAntichain(size_t, std::mt19937&) {
+		return edge_list();
+	}
+
+	//Square lattice, in which every cell is a diamond.
+	edge_list makeDiamond(size_t n, std::mt19937&) {
+		edge_list edges;
+		size_t width = 1;
+		while (width * width < n) {
+			++width;
+		}
+		for (uint32_t i = 0; i < n; ++i) {
+			if ((i + 1) % width != 0 && i + 1 < n) {
+				edges.emplace_back(i, i + 1);
+			}
+			if (i + width < n) {
+				edges.emplace_back(i, static_cast<uint32_t>(i + width));
+			}
+		}
+		return edges;
+	}
+
+	//Sparse DAG: every element gets two random parents.
+	edge_list makeRandom(size_t n, std::mt19937& rng) {
+		edge_list edges;
+		for (uint32_t i = 1; i < n; ++i) {
+			std::uniform_int_distribution<uint32_t> parent(0, i - 1);
+			edges.emplace_back(parent(rng), i);
+			edges.emplace_back(parent(rng), i);
+		}
+		std::shuffle(edges.begin(), edges.end(), rng);
+		return edges;
+	}
+
+	//Dependency-like graph: layers of elements, each of them depending
+	//on three random elements of the previous layer.
+	edge_list makeLayered(size_t n, std::mt19937& rng) {
+		edge_list edges;
+		size_t layers = std::max<size_t>(2, n / 32);
+		size_t width = std::max<size_t>(1, n / layers);
+		for (uint32_t i = static_cast<uint32_t>(width); i < n; ++i) {
+			size_t layerStart = (i / width - 1) * width;
+			std::uniform_int_distribution<size_t> parent(layerStart,
+				layerStart + width - 1);
+			for (int k = 0; k < 3; ++k) {
+				edges.emplace_back(static_cast<uint32_t>(parent(rng)), i);
+			}
+		}
+		return edges;
+	}
+
+	std::function<edge_list(size_t, std::mt19937&)> workload(
+		const string& name) {
+		if (name == "chain") {
+			return makeChain;
+		}
+		else if (name == "antichain") {
+			return makeAntichain;
+		}
+		else if (name == "diamond") {
+			return makeDiamond;
+		}
+		else if (name == "random") {
+			return makeRandom;
+		}
+		else if (name == "layered") {
+			return makeLayered;
+		}
+		return nullptr;
+	}
+
+	//Latencies of a single function, in nanoseconds.
+	struct Samples {
+		vector<uint64_t> latencies;
+		uint64_t total = 0;
+
+		template <typename F>
+		void measure(F&& f) {
+			auto start = bench_clock::now();
+			f();
+			auto end = bench_clock::now();
+			uint64_t ns = std::chrono::duration_cast<
+				std::chrono::nanoseconds>(end - start).count();
+			latencies.push_back(ns);
+			total += ns;
+		}
+	};
+
+	uint64_t percentile(vector<uint64_t>& sorted, double p) {
+		if (sorted.empty()) {
+			return 0;
+		}
+		size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+		return sorted[index];
+	}
+
+	void report(const string& workloadName, size_t n, bool closure,
+		const char* function, Samples& samples) {
+		vector<uint64_t>& l = samples.latencies;
+		std::sort(l.begin(), l.end());
+		double seconds = samples.total / 1e9;
+		printf("{\"workload\":\"%s\",\"n\":%zu,\"closure\":%s,"
+			"\"function\":\"%s\",\"calls\":%zu,\"total_ns\":%llu,"
+			"\"ops_per_sec\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu}\n",
+			workloadName.c_str(), n, closure ? "true" : "false", function,
+			l.size(), static_cast<unsigned long long>(samples.total),
+			seconds > 0 ? l.size() / seconds : 0.0,
+			static_cast<unsigned long long>(percentile(l, 0.5)),
+			static_cast<unsigned long long>(percentile(l, 0.99)));
+		fflush(stdout);
+	}
+
+	void run(const string& workloadName, size_t n, const Options& options) {
+		std::mt19937 rng(options.seed);
+		edge_list edges = workload(workloadName)(n, rng);
+		vector<string> names(n);
+		for (size_t i = 0; i < n; ++i) {
+			names[i] = "e" + std::to_string(i);
+		}
+
+		Samples newSamples;
+		unsigned long id = 0;
+		newSamples.measure([&]() { id = cxx::poset_new(); });
+		if (options.closure) {
+			cxx::poset_set_closure(id, true);
+		}
+
+		Samples insertSamples;
+		for (const string& name : names) {
+			insertSamples.measure([&]() {
+				cxx::poset_insert(id, name.c_str());
+			});
+		}
+
+		Samples addSamples;
+		for (const auto& edge : edges) {
+			addSamples.measure([&]() {
+				cxx::poset_add(id, names[edge.first].c_str(),
+					names[edge.second].c_str());
+			});
+		}
+
+		//Tests walk a part of the poset each, so fewer of them are run
+		//on the big ones.
+		size_t queries = std::min<size_t>(10000,
+			std::max<size_t>(100, 10000000 / std::max<size_t>(n, 1)));
+		std::uniform_int_distribution<size_t> element(0, n - 1);
+		Samples testSamples;
+		for (size_t q = 0; q < queries; ++q) {
+			const string& a = names[element(rng)];
+			const string& b = names[element(rng)];
+			testSamples.measure([&]() {
+				cxx::poset_test(id, a.c_str(), b.c_str());
+			});
+		}
+
+		Samples sizeSamples;
+		for (size_t q = 0; q < queries; ++q) {
+			sizeSamples.measure([&]() { cxx::poset_size(id); });
+		}
+
+		edge_list toDelete = edges;
+		std::shuffle(toDelete.begin(), toDelete.end(), rng);
+		toDelete.resize(std::min<size_t>(toDelete.size(), 1000));
+		Samples delSamples;
+		for (const auto& edge : toDelete) {
+			delSamples.measure([&]() {
+				cxx::poset_del(id, names[edge.first].c_str(),
+					names[edge.second].c_str());
+			});
+		}
+
+		Samples removeSamples;
+		for (size_t r = 0; r < std::min<size_t>(n / 2, 1000); ++r) {
+			const string& name = names[element(rng)];
+			removeSamples.measure([&]() {
+				cxx::poset_remove(id, name.c_str());
+			});
+		}
+
+		//Clear and delete are measured on a poset of full size.
+		for (const auto& edge : edges) {
+			cxx::poset_add(id, names[edge.first].c_str(),
+				names[edge.second].c_str());
+		}
+		Samples clearSamples;
+		clearSamples.measure([&]() { cxx::poset_clear(id); });
+
+		for (const string& name : names) {
+			cxx::poset_insert(id, name.c_str());
+		}
+		for (const auto& edge : edges) {
+			cxx::poset_add(id, names[edge.first].c_str(),
+				names[edge.second].c_str());
+		}
+		Samples deleteSamples;
+		deleteSamples.measure([&]() { cxx::poset_delete(id); });
+
+		report(workloadName, n, options.closure, "poset_new", newSamples);
+		report(workloadName, n, options.closure, "poset_insert",
+			insertSamples);
+		report(workloadName, n, options.closure, "poset_add", addSamples);
+		report(workloadName, n, options.closure, "poset_test", testSamples);
+		report(workloadName, n, options.closure, "poset_size", sizeSamples);
+		report(workloadName, n, options.closure, "poset_del", delSamples);
+		report(workloadName, n, options.closure, "poset_remove",
+			removeSamples);
+		report(workloadName, n, options.closure, "poset_clear",
+			clearSamples);
+		report(workloadName, n, options.closure, "poset_delete",
+			deleteSamples);
+	}
+
+	//Splits the comma separated list.
+	vector<string> split(const string& list) {
+		vector<string> parts;
+		size_t start = 0;
+		while (start <= list.size()) {
+			size_t end = list.find(',', start);
+			if (end == string::npos) {
+				end = list.size();
+			}
+			if (end > start) {
+				parts.push_back(list.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		return parts;
+	}
+
+	bool parseOptions(int argc, char* argv[], Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			string arg = argv[i];
+			if (arg.rfind("--sizes=", 0) == 0) {
+				options.sizes.clear();
+				for (const string& size : split(arg.substr(8))) {
+					options.sizes.push_back(std::stoul(size));
+				}
+			}
+			else if (arg.rfind("--workloads=", 0) == 0) {
+				options.workloads = split(arg.substr(12));
+				for (const string& name : options.workloads) {
+					if (!workload(name)) {
+						fprintf(stderr, "unknown workload: %s\n", name.c_str());
+						return false;
+					}
+				}
+			}
+			else if (arg == "--closure") {
+				options.closure = true;
+			}
+			else if (arg.rfind("--seed=", 0) == 0) {
+				options.seed = static_cast<unsigned>(std::stoul(arg.substr(7)));
+			}
+			else {
+				fprintf(stderr, "usage: %s [--sizes=10,100,...] "
+					"[--workloads=chain,antichain,diamond,random,layered] "
+					"[--closure] [--seed=N]\n", argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		return 1;
+	}
+
+	for (const string& workloadName : options.workloads) {
+		for (size_t n : options.sizes) {
+			if (n > 0) {
+				run(workloadName, n, options);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <unordered_set>
+#include "poset.h"
+
+//Checks that the ids of the deleted posets stay invalid, even after their
+//slots were reused more times than the generation bits of the ids can
+//count. Where unsigned long has 32 bits, that's 4096 reuses of a slot.
+//
+//Usage: registry_test
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const char* what, unsigned long id) {
+		if (!condition) {
+			fprintf(stderr, "FAILED: %s (id %lu)\n", what, id);
+			++failures;
+		}
+	}
+}
+
+int main() {
+	//Bits of the id left for the generation of its slot.
+	unsigned generationBits = sizeof(unsigned long) >= 8 ? 32 : 12;
+	unsigned long cycles = generationBits < 16 ?
+		(1ul << generationBits) + 16 : 100000;
+
+	unsigned long stale = cxx::poset_new();
+	cxx::poset_delete(stale);
+	std::unordered_set<unsigned long> seen{ stale };
+	for (unsigned long i = 0; i < cycles; ++i) {
+		unsigned long id = cxx::poset_new();
+		check(seen.insert(id).second, "id repeated", id);
+		check(!cxx::poset_insert(stale, "x"), "stale id resolved", stale);
+		cxx::poset_delete(id);
+		check(!cxx::poset_insert(id, "x"), "deleted id resolved", id);
+	}
+
+	//Several posets alive at once share the slots evenly.
+	unsigned long live[8];
+	for (unsigned long& id : live) {
+		id = cxx::poset_new();
+		check(seen.insert(id).second, "id repeated", id);
+		check(cxx::poset_insert(id, "x"), "live id not resolved", id);
+	}
+	for (unsigned long id : live) {
+		cxx::poset_delete(id);
+	}
+	check(!cxx::poset_insert(stale, "x"), "stale id resolved", stale);
+
+	printf("registry_test: %lu create/delete cycles, %d failure(s)\n",
+		cycles, failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "poset.h"
+#include "poset_trace.h"
+
+//Decoder of the trace files written by poset_trace_dump. Prints one line
+//per traced call, ordered by time, with timestamps relative to the first
+//call.
+//
+//Usage: poset_trace_decode FILE
+
+using std::vector;
+
+namespace {
+	const char* opName(uint16_t op) {
+		switch (op) {
+		case cxx::POSET_OP_NEW: return "poset_new";
+		case cxx::POSET_OP_DELETE: return "poset_delete";
+		case cxx::POSET_OP_SIZE: return "poset_size";
+		case cxx::POSET_OP_INSERT: return "poset_insert";
+		case cxx::POSET_OP_REMOVE: return "poset_remove";
+		case cxx::POSET_OP_ADD: return "poset_add";
+		case cxx::POSET_OP_DEL: return "poset_del";
+		case cxx::POSET_OP_TEST: return "poset_test";
+		case cxx::POSET_OP_CLEAR: return "poset_clear";
+		case cxx::POSET_OP_COMPARE: return "poset_compare";
+		default: return "unknown";
+		}
+	}
+
+	void printElement(uint32_t element) {
+		if (element == POSET_TRACE_NO_ELEMENT) {
+			printf(" -");
+		}
+		else {
+			printf(" #%u", element);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s FILE\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(argv[1], "rb");
+	if (file == nullptr) {
+		perror(argv[1]);
+		return 1;
+	}
+	poset_trace_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		header.magic != POSET_TRACE_MAGIC) {
+		fprintf(stderr, "%s: not a poset trace\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+	if (header.version != POSET_TRACE_VERSION ||
+		header.record_size != sizeof(poset_trace_record)) {
+		fprintf(stderr, "%s: unsupported trace version %u\n", argv[1],
+			header.version);
+		fclose(file);
+		return 1;
+	}
+	//The count comes from the file, so it's checked against the file's
+	//size before anything is allocated for it.
+	long recordsStart = ftell(file);
+	long fileSize = -1;
+	if (recordsStart >= 0 && fseek(file, 0, SEEK_END) == 0) {
+		fileSize = ftell(file);
+	}
+	if (fileSize < recordsStart ||
+		fseek(file, recordsStart, SEEK_SET) != 0) {
+		fprintf(stderr, "%s: cannot determine the size\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+	uint64_t available = static_cast<uint64_t>(fileSize - recordsStart) /
+		sizeof(poset_trace_record);
+	if (header.count > available) {
+		fprintf(stderr, "%s: truncated or corrupt, header claims %llu "
+			"record(s), file holds %llu\n", argv[1],
+			static_cast<unsigned long long>(header.count),
+			static_cast<unsigned long long>(available));
+	}
+	vector<poset_trace_record> records(static_cast<size_t>(
+		std::min(header.count, available)));
+	size_t read = fread(records.data(), sizeof(poset_trace_record),
+		records.size(), file);
+	fclose(file);
+	if (read != records.size()) {
+		fprintf(stderr, "%s: truncated, %zu of %zu record(s)\n", argv[1],
+			read, records.size());
+		records.resize(read);
+	}
+
+	std::stable_sort(records.begin(), records.end(),
+		[](const poset_trace_record& a, const poset_trace_record& b) {
+			return a.timestamp_ns < b.timestamp_ns;
+		});
+	uint64_t start = records.empty() ? 0 : records.front().timestamp_ns;
+	for (const poset_trace_record& record : records) {
+		printf("%12.3f us  thread %u  %s(%llu)",
+			(record.timestamp_ns - start) / 1e3, record.thread,
+			opName(record.op),
+			static_cast<unsigned long long>(record.poset_id));
+		printElement(record.element1);
+		printElement(record.element2);
+		printf(" -> %u\n", record.result);
+	}
+	return 0;
+}